@@ -0,0 +1,76 @@
+// PingPongOS - PingPong Operating System
+
+// Microbenchmark: trocas de contexto por segundo entre duas tarefas,
+// usando context_switch (com e sem estado de ponto flutuante) e swapcontext
+
+#include "../ppos_context.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ucontext.h>
+
+#define SWITCHES 4000000
+#define STACKSIZE 32768
+
+context_t main_context, task_context;
+ucontext_t main_ucontext, task_ucontext;
+
+void Body(void *arg) {
+  for (;;)
+    context_switch(&task_context, &main_context);
+}
+
+void UBody() {
+  for (;;)
+    swapcontext(&task_ucontext, &main_ucontext);
+}
+
+double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Trocas por segundo com context_switch, ambos os contextos com o mesmo fpu
+double ctx_rate(int fpu) {
+  context_set_fpu(&main_context, fpu);
+  context_set_fpu(&task_context, fpu);
+
+  double start = now();
+  for (int i = 0; i < SWITCHES / 2; i++)
+    context_switch(&main_context, &task_context);
+  return SWITCHES / (now() - start);
+}
+
+int main(int argc, char *argv[]) {
+  double start, elapsed, fpu_rate, nofpu_rate, uctx_rate;
+
+  context_make(&task_context, malloc(STACKSIZE), STACKSIZE, Body, NULL);
+
+  // primeiro com fpu: ao desligar depois, o estado salvo continua válido
+  fpu_rate = ctx_rate(1);
+  nofpu_rate = ctx_rate(0);
+
+  getcontext(&task_ucontext);
+  task_ucontext.uc_stack.ss_sp = malloc(STACKSIZE);
+  task_ucontext.uc_stack.ss_size = STACKSIZE;
+  task_ucontext.uc_stack.ss_flags = 0;
+  task_ucontext.uc_link = 0;
+  makecontext(&task_ucontext, UBody, 0);
+
+  start = now();
+  for (int i = 0; i < SWITCHES / 2; i++)
+    swapcontext(&main_ucontext, &task_ucontext);
+  elapsed = now() - start;
+  uctx_rate = SWITCHES / elapsed;
+
+  printf("context_switch (fpu):    %12.0f switches/s (%6.1f ns/switch)\n",
+         fpu_rate, 1e9 / fpu_rate);
+  printf("context_switch (no fpu): %12.0f switches/s (%6.1f ns/switch)\n",
+         nofpu_rate, 1e9 / nofpu_rate);
+  printf("swapcontext:             %12.0f switches/s (%6.1f ns/switch)\n",
+         uctx_rate, 1e9 / uctx_rate);
+  printf("speedup:                 %12.1fx\n", nofpu_rate / uctx_rate);
+
+  exit(0);
+}
@@ -0,0 +1,177 @@
+// PingPongOS - PingPong Operating System
+
+// Microbenchmark de filas de mensagens, entre uma tarefa produtora e uma
+// consumidora:
+// - vazão com registros grandes, usando a API com cópia (mqueue_send e
+//   mqueue_recv) e a API sem cópia (reserve/commit e borrow/release); o
+//   registro é montado e lido nas duas versões;
+// - mensagens pequenas por segundo, uma a uma e em lotes (mqueue_send_many
+//   e mqueue_recv_many), e uma a uma numa fila MQUEUE_SPSC;
+// - mensagens por segundo com tamanhos mistos (quase todas de MIXED_SIZE
+//   bytes, uma a cada BIG_EVERY de MSG_SIZE), numa fila de posições fixas de
+//   MSG_SIZE bytes e numa fila MQUEUE_VAR de MIXED_BYTES bytes.
+
+#include "../ppos.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MSG_SIZE 16384
+#define SMALL_SIZE 8
+#define CAPACITY 8
+#define SMALL_CAPACITY 256
+#define BATCH 32
+#define MESSAGES 50000
+#define SMALL_MESSAGES 2000000
+#define MIXED_SIZE 32
+#define BIG_EVERY 64
+#define MIXED_BYTES 65536
+#define MIXED_MESSAGES 500000
+
+enum { COPY, ZERO_COPY, SINGLE, BATCHED, SPSC, MIXED_FIXED, MIXED_VAR, MODES };
+
+task_t producer[MODES], consumer[MODES];
+semaphore_t s_done, s_park;
+mqueue_t queue;
+int mode;
+long checksum;
+
+// tamanho da i-ésima mensagem no teste de tamanhos mistos
+int mixed_size(int i) { return i % BIG_EVERY == 0 ? MSG_SIZE : MIXED_SIZE; }
+
+double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// avisa a main e fica bloqueada até o fim
+void Done() {
+  sem_up(&s_done);
+  sem_down(&s_park);
+}
+
+void ProducerBody(void *arg) {
+  char record[MSG_SIZE];
+  long small[BATCH];
+
+  if (mode == COPY || mode == ZERO_COPY) {
+    for (int i = 0; i < MESSAGES; i++) {
+      if (mode == ZERO_COPY) {
+        char *slot = mqueue_send_reserve(&queue);
+        memset(slot, i, MSG_SIZE);
+        mqueue_send_commit(&queue, slot);
+      } else {
+        memset(record, i, MSG_SIZE);
+        mqueue_send(&queue, record);
+      }
+    }
+  } else if (mode == MIXED_FIXED || mode == MIXED_VAR) {
+    for (int i = 0; i < MIXED_MESSAGES; i++) {
+      memset(record, i, mixed_size(i));
+      if (mode == MIXED_VAR)
+        mqueue_send_var(&queue, record, mixed_size(i));
+      else
+        mqueue_send(&queue, record);
+    }
+  } else if (mode == SINGLE || mode == SPSC) {
+    for (long i = 0; i < SMALL_MESSAGES; i++)
+      mqueue_send(&queue, &i);
+  } else {
+    for (long i = 0; i < SMALL_MESSAGES;) {
+      int n = SMALL_MESSAGES - i < BATCH ? SMALL_MESSAGES - i : BATCH;
+      for (int j = 0; j < n; j++)
+        small[j] = i + j;
+      i += mqueue_send_many(&queue, small, n);
+    }
+  }
+
+  Done();
+}
+
+void ConsumerBody(void *arg) {
+  char record[MSG_SIZE];
+  long small[BATCH];
+
+  if (mode == COPY || mode == ZERO_COPY) {
+    for (int i = 0; i < MESSAGES; i++) {
+      if (mode == ZERO_COPY) {
+        char *slot = mqueue_recv_borrow(&queue);
+        checksum += slot[0] + slot[MSG_SIZE - 1];
+        mqueue_recv_release(&queue, slot);
+      } else {
+        mqueue_recv(&queue, record);
+        checksum += record[0] + record[MSG_SIZE - 1];
+      }
+    }
+  } else if (mode == MIXED_FIXED || mode == MIXED_VAR) {
+    for (int i = 0; i < MIXED_MESSAGES; i++) {
+      if (mode == MIXED_VAR)
+        mqueue_recv_var(&queue, record, MSG_SIZE);
+      else
+        mqueue_recv(&queue, record);
+      checksum += record[0];
+    }
+  } else if (mode == SINGLE || mode == SPSC) {
+    for (long i = 0; i < SMALL_MESSAGES; i++) {
+      mqueue_recv(&queue, small);
+      checksum += small[0];
+    }
+  } else {
+    for (long i = 0; i < SMALL_MESSAGES;) {
+      int n = mqueue_recv_many(&queue, small, BATCH);
+      for (int j = 0; j < n; j++)
+        checksum += small[j];
+      i += n;
+    }
+  }
+
+  Done();
+}
+
+// Segundos para passar todas as mensagens pela fila
+double elapsed(int run_mode, int capacity, int size) {
+  mode = run_mode;
+  int options = mode == SPSC ? MQUEUE_SPSC : mode == MIXED_VAR ? MQUEUE_VAR : 0;
+  mqueue_create_opt(&queue, capacity, size, options);
+
+  double start = now();
+  task_create(&producer[mode], ProducerBody, NULL);
+  task_create(&consumer[mode], ConsumerBody, NULL);
+  sem_down(&s_done);
+  sem_down(&s_done);
+  double time = now() - start;
+
+  mqueue_destroy(&queue);
+  return time;
+}
+
+int main(int argc, char *argv[]) {
+  ppos_init();
+  sem_create(&s_done, 0);
+  sem_create(&s_park, 0);
+
+  double bytes = (double)MESSAGES * MSG_SIZE / 1e6;
+  printf("mqueue com copia, %d bytes: %7.1f MB/s\n", MSG_SIZE,
+         bytes / elapsed(COPY, CAPACITY, MSG_SIZE));
+  printf("mqueue sem copia, %d bytes: %7.1f MB/s\n", MSG_SIZE,
+         bytes / elapsed(ZERO_COPY, CAPACITY, MSG_SIZE));
+
+  double msgs = SMALL_MESSAGES / 1e6;
+  printf("mqueue uma a uma, %d bytes: %7.2f M msgs/s\n", SMALL_SIZE,
+         msgs / elapsed(SINGLE, SMALL_CAPACITY, SMALL_SIZE));
+  printf("mqueue em lotes de %d, %d bytes: %7.2f M msgs/s\n", BATCH,
+         SMALL_SIZE, msgs / elapsed(BATCHED, SMALL_CAPACITY, SMALL_SIZE));
+  printf("mqueue SPSC uma a uma, %d bytes: %7.2f M msgs/s\n", SMALL_SIZE,
+         msgs / elapsed(SPSC, SMALL_CAPACITY, SMALL_SIZE));
+
+  msgs = MIXED_MESSAGES / 1e6;
+  printf("mqueue tamanhos mistos, fixa de %d KB: %7.2f M msgs/s\n",
+         CAPACITY * MSG_SIZE / 1024,
+         msgs / elapsed(MIXED_FIXED, CAPACITY, MSG_SIZE));
+  printf("mqueue tamanhos mistos, MQUEUE_VAR de %d KB: %7.2f M msgs/s\n",
+         MIXED_BYTES / 1024, msgs / elapsed(MIXED_VAR, MIXED_BYTES, MSG_SIZE));
+
+  exit(0);
+}
@@ -0,0 +1,51 @@
+// PingPongOS - PingPong Operating System
+
+// Microbenchmark: latência de escolha do escalonador (scheduler) com 1 mil e
+// 10 mil tarefas prontas, espalhadas por todos os níveis de prioridade. Cada
+// tarefa escolhida volta para a fila de prontas, como numa preempção.
+
+#include "../ppos.h"
+#include "../ppos_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_TASKS 10000
+#define PICKS 4000000
+
+task_t tasks[MAX_TASKS];
+int num_tasks = 0;
+
+double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void Body(void *arg) { task_exit(0); }
+
+// Nanossegundos por escolha com n tarefas prontas
+double pick_latency(int n) {
+  for (; num_tasks < n; num_tasks++) {
+    task_create(&tasks[num_tasks], Body, NULL);
+    task_setprio(&tasks[num_tasks], num_tasks % PRIO_LEVELS + PRIO_MIN);
+  }
+
+  double start = now();
+  for (int i = 0; i < PICKS; i++)
+    __ready_queue_append(scheduler());
+  return (now() - start) * 1e9 / PICKS;
+}
+
+int main(int argc, char *argv[]) {
+  ppos_init();
+
+  // a main não deve ceder o processador para as tarefas criadas
+  main_task.preemptible = 0;
+
+  printf("task_t: %zu bytes\n", sizeof(task_t));
+  printf("scheduler,  1000 tarefas: %6.1f ns/escolha\n", pick_latency(1000));
+  printf("scheduler, 10000 tarefas: %6.1f ns/escolha\n", pick_latency(10000));
+
+  exit(0);
+}
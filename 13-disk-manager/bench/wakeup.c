@@ -0,0 +1,74 @@
+// PingPongOS - PingPong Operating System
+
+// Microbenchmark: tempo para acordar todas as tarefas bloqueadas num
+// semáforo, com 1 mil e 10 mil tarefas, usando sem_up uma vez por tarefa e
+// sem_up_n uma única vez.
+
+#include "../ppos.h"
+#include "../ppos_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_TASKS 10000
+#define ROUNDS 20
+
+task_t tasks[MAX_TASKS];
+semaphore_t s;
+int num_tasks = 0;
+
+double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void Body(void *arg) {
+  for (;;)
+    sem_down(&s);
+}
+
+// Cede o processador até que n tarefas estejam bloqueadas no semáforo
+void wait_blocked(int n) {
+  while (queue_head_size(&s.waiting) < n)
+    task_yield();
+}
+
+// Microssegundos para acordar n tarefas
+double wakeup_time(int n, int batched) {
+  double total = 0;
+
+  for (; num_tasks < n; num_tasks++)
+    task_create(&tasks[num_tasks], Body, NULL);
+
+  for (int r = 0; r < ROUNDS; r++) {
+    wait_blocked(n);
+
+    double start = now();
+    if (batched)
+      sem_up_n(&s, n);
+    else
+      for (int i = 0; i < n; i++)
+        sem_up(&s);
+    total += now() - start;
+  }
+
+  return total * 1e6 / ROUNDS;
+}
+
+int main(int argc, char *argv[]) {
+  ppos_init();
+  sem_create(&s, 0);
+
+  // a main não deve ceder o processador no meio da medição, e deve ficar
+  // atrás das tarefas acordadas
+  main_task.preemptible = 0;
+  task_setprio(&main_task, PRIO_MAX);
+
+  for (int n = 1000; n <= MAX_TASKS; n *= 10) {
+    printf("sem_up,   %5d tarefas: %8.1f us\n", n, wakeup_time(n, 0));
+    printf("sem_up_n, %5d tarefas: %8.1f us\n", n, wakeup_time(n, 1));
+  }
+
+  exit(0);
+}
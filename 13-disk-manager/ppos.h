@@ -36,6 +36,18 @@ int task_create (task_t *task,			// descritor da nova tarefa
                  void (*start_func)(void *),	// funcao corpo da tarefa
                  void *arg) ;			// argumentos para a tarefa
 
+// Como task_create, mas com uma pilha de stack_size bytes (arredondado para
+// cima); task_create usa pilhas de 32 KB
+int task_create_sized (task_t *task,
+                       void (*start_func)(void *),
+                       void *arg,
+                       int stack_size) ;
+
+// informa se a tarefa usa ponto flutuante (padrão: sim); tarefas que não
+// usam têm trocas de contexto mais baratas. Só pode ser chamada pela própria
+// tarefa ou antes de ela executar pela primeira vez (NULL = tarefa corrente)
+int task_setfpu (task_t *task, int uses_fpu) ;
+
 // Termina a tarefa corrente, indicando um valor de status encerramento
 void task_exit (int exitCode) ;
 
@@ -62,6 +74,17 @@ int task_getprio (task_t *task) ;
 // a tarefa corrente aguarda o encerramento de outra task
 int task_join (task_t *task) ;
 
+// como task_join, mas devolve -1 sem esperar se a tarefa não terminou
+int task_join_try (task_t *task) ;
+
+// como task_join, mas espera no máximo t_ms milissegundos; devolve -1 se o
+// prazo expirar
+int task_join_timed (task_t *task, int t_ms) ;
+
+// desvincula a tarefa: ela não pode mais ser aguardada com task_join e seus
+// recursos são liberados assim que ela terminar (NULL = tarefa corrente)
+int task_detach (task_t *task) ;
+
 // operações de gestão do tempo ================================================
 
 // suspende a tarefa corrente por t milissegundos
@@ -77,12 +100,30 @@ unsigned int systime () ;
 // cria um semáforo com valor inicial "value"
 int sem_create (semaphore_t *s, int value) ;
 
+// cria um semáforo binário (valor 0 ou 1) com herança de prioridade: quem o
+// obtém com sem_down herda a prioridade de quem espera por ele até o sem_up
+int sem_create_binary (semaphore_t *s, int value) ;
+
+// cria um semáforo com opções (SEM_BINARY, WAKE_PRIO); com WAKE_PRIO, sem_up
+// acorda a tarefa de maior prioridade, e não a que chegou primeiro
+int sem_create_opt (semaphore_t *s, int value, int options) ;
+
 // requisita o semáforo
 int sem_down (semaphore_t *s) ;
 
+// requisita o semáforo sem esperar; devolve -1 se ele não está disponível
+int sem_down_try (semaphore_t *s) ;
+
+// requisita o semáforo esperando no máximo t_ms milissegundos; devolve -1
+// se o prazo expirar
+int sem_down_timed (semaphore_t *s, int t_ms) ;
+
 // libera o semáforo
 int sem_up (semaphore_t *s) ;
 
+// libera o semáforo n vezes de uma só vez, acordando até n tarefas
+int sem_up_n (semaphore_t *s, int n) ;
+
 // destroi o semáforo, liberando as tarefas bloqueadas
 int sem_destroy (semaphore_t *s) ;
 
@@ -91,6 +132,10 @@ int sem_destroy (semaphore_t *s) ;
 // Inicializa um mutex (sempre inicialmente livre)
 int mutex_create (mutex_t *m) ;
 
+// Inicializa um mutex com opções (WAKE_PRIO): com WAKE_PRIO, mutex_unlock
+// entrega o mutex à tarefa de maior prioridade, e não à que chegou primeiro
+int mutex_create_opt (mutex_t *m, int options) ;
+
 // Solicita um mutex
 int mutex_lock (mutex_t *m) ;
 
@@ -105,6 +150,11 @@ int mutex_destroy (mutex_t *m) ;
 // Inicializa uma barreira
 int barrier_create (barrier_t *b, int N) ;
 
+// Inicializa uma barreira cuja última tarefa a chegar executa leader(arg)
+// antes de liberar as demais, a cada geração
+int barrier_create_leader (barrier_t *b, int N, void (*leader)(void *),
+                           void *arg) ;
+
 // Chega a uma barreira
 int barrier_join (barrier_t *b) ;
 
@@ -116,12 +166,66 @@ int barrier_destroy (barrier_t *b) ;
 // cria uma fila para até max mensagens de size bytes cada
 int mqueue_create (mqueue_t *queue, int max, int size) ;
 
+// cria uma fila com opções (MQUEUE_SPSC ou MQUEUE_VAR). Com MQUEUE_SPSC, só
+// uma tarefa envia e só uma recebe; as mensagens passam sem travas enquanto a
+// fila não está cheia nem vazia, max é arredondado para uma potência de 2, e
+// cada lado tem no máximo uma posição reservada ou emprestada por vez. Com
+// MQUEUE_VAR, max é a capacidade em bytes e size o tamanho máximo de uma
+// mensagem, e cada mensagem ocupa só seu tamanho mais um int; mqueue_send e
+// mqueue_recv passam mensagens de size bytes, e as chamadas em lote e sem
+// cópia não se aplicam
+int mqueue_create_opt (mqueue_t *queue, int max, int size, int options) ;
+
 // envia uma mensagem para a fila
 int mqueue_send (mqueue_t *queue, void *msg) ;
 
+// envia uma mensagem sem esperar; devolve -1 se a fila está cheia
+int mqueue_send_try (mqueue_t *queue, void *msg) ;
+
+// envia uma mensagem esperando no máximo t_ms milissegundos por espaço;
+// devolve -1 se o prazo expirar
+int mqueue_send_timed (mqueue_t *queue, void *msg, int t_ms) ;
+
 // recebe uma mensagem da fila
 int mqueue_recv (mqueue_t *queue, void *msg) ;
 
+// recebe uma mensagem sem esperar; devolve -1 se a fila está vazia
+int mqueue_recv_try (mqueue_t *queue, void *msg) ;
+
+// recebe uma mensagem esperando no máximo t_ms milissegundos por ela;
+// devolve -1 se o prazo expirar
+int mqueue_recv_timed (mqueue_t *queue, void *msg, int t_ms) ;
+
+// envia uma mensagem de size bytes para uma fila MQUEUE_VAR
+int mqueue_send_var (mqueue_t *queue, void *msg, int size) ;
+
+// recebe uma mensagem de uma fila MQUEUE_VAR em msg, que tem espaço para max
+// bytes, e devolve seu tamanho; se a mensagem não couber, ela fica na fila e
+// a chamada devolve -1
+int mqueue_recv_var (mqueue_t *queue, void *msg, int max) ;
+
+// envia até n mensagens consecutivas de msgs de uma só vez: espera apenas
+// pela primeira posição livre e devolve quantas enviou (-1 se erro)
+int mqueue_send_many (mqueue_t *queue, void *msgs, int n) ;
+
+// recebe até n mensagens em msgs de uma só vez: espera apenas pela primeira
+// mensagem e devolve quantas recebeu (-1 se erro)
+int mqueue_recv_many (mqueue_t *queue, void *msgs, int n) ;
+
+// reserva uma posição livre da fila e devolve seu endereço, para escrever a
+// mensagem diretamente nela (NULL se erro); a mensagem só é entregue no commit
+void *mqueue_send_reserve (mqueue_t *queue) ;
+
+// entrega a mensagem escrita na posição obtida com mqueue_send_reserve
+int mqueue_send_commit (mqueue_t *queue, void *slot) ;
+
+// devolve o endereço da próxima mensagem da fila, para lê-la diretamente
+// (NULL se erro); a posição só volta a ficar livre no release
+void *mqueue_recv_borrow (mqueue_t *queue) ;
+
+// libera a posição obtida com mqueue_recv_borrow
+int mqueue_recv_release (mqueue_t *queue, void *slot) ;
+
 // destroi a fila, liberando as tarefas bloqueadas
 int mqueue_destroy (mqueue_t *queue) ;
 
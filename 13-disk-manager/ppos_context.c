@@ -0,0 +1,190 @@
+// Context switching for PingPong OS
+// See ppos_context.h
+
+#include "ppos_context.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __APPLE__
+#define SYMBOL(name) "_" #name
+#else
+#define SYMBOL(name) #name
+#endif
+
+// First code run by a new context: calls start_routine(arg), which
+// context_make left in callee-saved registers
+void __context_trampoline();
+
+// Called if a task's body returns without task_exit, like uc_link = NULL
+void __context_exit() { exit(0); }
+
+#if defined(__x86_64__)
+
+// Frame left on the stack by context_switch, from the lowest address
+typedef struct {
+  uint32_t mxcsr; // SSE control/status
+  uint16_t fpucw; // x87 control word
+  uint16_t pad;
+  uint64_t r15, r14, r13, r12, rbx, rbp;
+  uint64_t ret; // where context_switch returns to
+} frame_t;
+
+// The FP control slot is always reserved, but only filled and loaded for
+// contexts that use the FPU, so the frame layout doesn't depend on the flag
+__asm__(".text\n"
+        ".globl " SYMBOL(context_switch) "\n"
+        ".p2align 4\n"
+        SYMBOL(context_switch) ":\n"
+        "  pushq %rbp\n"
+        "  pushq %rbx\n"
+        "  pushq %r12\n"
+        "  pushq %r13\n"
+        "  pushq %r14\n"
+        "  pushq %r15\n"
+        "  subq $8, %rsp\n"
+        "  cmpl $0, 8(%rdi)\n" // from->fpu
+        "  je 1f\n"
+        "  stmxcsr (%rsp)\n"
+        "  fnstcw 4(%rsp)\n"
+        "1:\n"
+        "  movq %rsp, (%rdi)\n" // from->sp = rsp
+        "  movq (%rsi), %rsp\n" // rsp = to->sp
+        "  cmpl $0, 8(%rsi)\n"  // to->fpu
+        "  je 2f\n"
+        "  ldmxcsr (%rsp)\n"
+        "  fldcw 4(%rsp)\n"
+        "2:\n"
+        "  addq $8, %rsp\n"
+        "  popq %r15\n"
+        "  popq %r14\n"
+        "  popq %r13\n"
+        "  popq %r12\n"
+        "  popq %rbx\n"
+        "  popq %rbp\n"
+        "  ret\n"
+        "\n"
+        ".p2align 4\n"
+        SYMBOL(__context_trampoline) ":\n"
+        "  andq $-16, %rsp\n"
+        "  movq %r13, %rdi\n"
+        "  callq *%r12\n"
+        "  callq " SYMBOL(__context_exit) "\n");
+
+void context_make(context_t *ctx, void *stack, size_t size,
+                  void (*start_routine)(void *), void *arg) {
+  uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+
+  // Leave a zeroed slot above the frame as the trampoline's return address
+  frame_t *frame = (frame_t *)(top - 8 - sizeof(frame_t));
+
+  frame->mxcsr = 0x1f80; // default: all exceptions masked
+  frame->fpucw = 0x037f; // default: all exceptions masked, double extended
+  frame->pad = 0;
+  frame->r15 = frame->r14 = frame->rbx = frame->rbp = 0;
+  frame->r12 = (uint64_t)start_routine;
+  frame->r13 = (uint64_t)arg;
+  frame->ret = (uint64_t)__context_trampoline;
+  *(uint64_t *)(top - 8) = 0;
+
+  ctx->sp = frame;
+  ctx->fpu = 1;
+}
+
+void context_set_fpu(context_t *ctx, int fpu) { ctx->fpu = fpu; }
+
+#elif defined(__aarch64__)
+
+// Frame left on the stack by context_switch, from the lowest address
+typedef struct {
+  uint64_t x19, x20, x21, x22, x23, x24, x25, x26, x27, x28;
+  uint64_t fp, lr; // x29, x30: context_switch returns to lr
+  uint64_t d8, d9, d10, d11, d12, d13, d14, d15;
+  uint64_t fpcr; // FP control: rounding mode, exception traps
+  uint64_t pad;  // keeps sp 16-byte aligned
+} frame_t;
+
+// As on x86-64, the FPCR slot is always reserved but only filled and loaded
+// for contexts that use the FPU. d8-d15 are always saved: they are
+// callee-saved and compilers may use them even in integer code
+__asm__(".text\n"
+        ".globl " SYMBOL(context_switch) "\n"
+        ".p2align 4\n"
+        SYMBOL(context_switch) ":\n"
+        "  sub sp, sp, #0xb0\n"
+        "  stp x19, x20, [sp, #0x00]\n"
+        "  stp x21, x22, [sp, #0x10]\n"
+        "  stp x23, x24, [sp, #0x20]\n"
+        "  stp x25, x26, [sp, #0x30]\n"
+        "  stp x27, x28, [sp, #0x40]\n"
+        "  stp x29, x30, [sp, #0x50]\n"
+        "  stp d8, d9, [sp, #0x60]\n"
+        "  stp d10, d11, [sp, #0x70]\n"
+        "  stp d12, d13, [sp, #0x80]\n"
+        "  stp d14, d15, [sp, #0x90]\n"
+        "  ldr w10, [x0, #8]\n" // from->fpu
+        "  cbz w10, 1f\n"
+        "  mrs x9, fpcr\n"
+        "  str x9, [sp, #0xa0]\n"
+        "1:\n"
+        "  mov x9, sp\n"
+        "  str x9, [x0]\n" // from->sp = sp
+        "  ldr x9, [x1]\n" // sp = to->sp
+        "  mov sp, x9\n"
+        "  ldr w10, [x1, #8]\n" // to->fpu
+        "  cbz w10, 2f\n"
+        "  ldr x9, [sp, #0xa0]\n"
+        "  msr fpcr, x9\n"
+        "2:\n"
+        "  ldp x19, x20, [sp, #0x00]\n"
+        "  ldp x21, x22, [sp, #0x10]\n"
+        "  ldp x23, x24, [sp, #0x20]\n"
+        "  ldp x25, x26, [sp, #0x30]\n"
+        "  ldp x27, x28, [sp, #0x40]\n"
+        "  ldp x29, x30, [sp, #0x50]\n"
+        "  ldp d8, d9, [sp, #0x60]\n"
+        "  ldp d10, d11, [sp, #0x70]\n"
+        "  ldp d12, d13, [sp, #0x80]\n"
+        "  ldp d14, d15, [sp, #0x90]\n"
+        "  add sp, sp, #0xb0\n"
+        "  ret\n"
+        "\n"
+        ".p2align 4\n"
+        SYMBOL(__context_trampoline) ":\n"
+        "  mov x0, x20\n"
+        "  blr x19\n"
+        "  bl " SYMBOL(__context_exit) "\n");
+
+void context_make(context_t *ctx, void *stack, size_t size,
+                  void (*start_routine)(void *), void *arg) {
+  uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+  frame_t *frame = (frame_t *)(top - sizeof(frame_t));
+
+  *frame = (frame_t){0};
+  frame->x19 = (uint64_t)start_routine;
+  frame->x20 = (uint64_t)arg;
+  frame->lr = (uint64_t)__context_trampoline;
+  frame->fpcr = 0; // default: round to nearest, no exception traps
+
+  ctx->sp = frame;
+  ctx->fpu = 1;
+}
+
+void context_set_fpu(context_t *ctx, int fpu) { ctx->fpu = fpu; }
+
+#else
+
+void context_make(context_t *ctx, void *stack, size_t size,
+                  void (*start_routine)(void *), void *arg) {
+  getcontext(ctx);
+  ctx->uc_stack.ss_sp = stack;
+  ctx->uc_stack.ss_size = size;
+  ctx->uc_stack.ss_flags = 0;
+  ctx->uc_link = 0;
+  makecontext(ctx, (void (*)())start_routine, 1, arg);
+}
+
+void context_switch(context_t *from, context_t *to) { swapcontext(from, to); }
+
+void context_set_fpu(context_t *ctx, int fpu) {}
+
+#endif
@@ -0,0 +1,42 @@
+// Context switching for PingPong OS
+//
+// On x86-64 and aarch64 a context is the saved stack pointer: the
+// callee-saved registers are pushed on the task's own stack by
+// context_switch. FP control state is only switched for contexts that use
+// it. Unlike swapcontext, the signal mask is not saved, so no system call
+// is made on a switch. Other architectures fall back to ucontext.
+
+#ifndef __PPOS_CONTEXT__
+#define __PPOS_CONTEXT__
+
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define CONTEXT_ASM 1
+
+typedef struct {
+  void *sp; // stack pointer, with the callee-saved registers on top
+  int fpu;  // save and restore the FP control state: MXCSR and the x87
+            // control word on x86-64, FPCR on aarch64
+} context_t;
+
+#else
+#include <ucontext.h>
+
+typedef ucontext_t context_t;
+#endif
+
+// Prepares ctx so that switching to it runs start_routine(arg) on the given
+// stack. If start_routine returns, the process exits.
+void context_make(context_t *ctx, void *stack, size_t size,
+                  void (*start_routine)(void *), void *arg);
+
+// Saves the current context in from and resumes the one in to
+void context_switch(context_t *from, context_t *to);
+
+// Tells whether the context uses floating point, and so needs its FP control
+// state kept across switches (the default after context_make). Only safe
+// while the context is running or before it first runs.
+void context_set_fpu(context_t *ctx, int fpu);
+
+#endif
@@ -8,7 +8,14 @@
 #include <sys/time.h>
 
 int next_task_id = 1; // IDs for other tasks start at 1
+int live_tasks = 0;   // tasks created and not reaped yet (main aside)
 unsigned int system_ticks_count = 0;
+unsigned long long boot_us = 0;
+unsigned int idle_ticks_count = 0;
+short is_idle = 0;
+int preemption_disabled = 0; // nesting depth of kernel critical sections
+short preemption_pending = 0;
+void (*deferred_work)() = NULL;
 
 task_t main_task;
 task_t dispatcher_task;
@@ -16,7 +23,10 @@ task_t *current_task;
 
 // Task queues for each state:
 // Ready, Waiting, Sleeping, Terminated
-task_t *queues[] = {NULL, NULL, NULL, NULL};
+// Ready and sleeping tasks are kept in ready_queue and sleep_queue instead
+queue_head_t queues[] = {{NULL, 0}, {NULL, 0}, {NULL, 0}, {NULL, 0}};
+ready_queue_t ready_queue;
+sleep_queue_t sleep_queue;
 
 struct sigaction action;
 struct itimerval timer;
@@ -35,37 +45,66 @@ void ppos_init() {
 }
 
 int task_create(task_t *task, void (*start_routine)(void *), void *arg) {
-  getcontext(&(task->context));
-
-  char *stack = malloc(STACKSIZE);
-  if (stack) {
-    task->context.uc_stack.ss_sp = stack;
-    task->context.uc_stack.ss_size = STACKSIZE;
-    task->context.uc_stack.ss_flags = 0;
-    task->context.uc_link = 0;
-  } else {
-    perror("task_create - malloc");
+  return task_create_sized(task, start_routine, arg, STACKSIZE);
+}
+
+int task_create_sized(task_t *task, void (*start_routine)(void *), void *arg,
+                      int stack_size) {
+  if (stack_size <= 0) {
+    fprintf(stderr, "task_create: invalid stack size %d\n", stack_size);
+    return -1;
+  }
+
+  // The pool is shared with the reaper, and the sleep heap is read by the
+  // timer handler (TICKLESS) and may move when it grows, so keep both out
+  // of preemption. Every live task, this one and main may be sleeping at
+  // the same time.
+  size_t size = stack_size;
+  __enter_cs();
+  if (__sleep_queue_reserve(live_tasks + 2) < 0) {
+    __leave_cs();
+    perror("task_create - realloc");
+    return -1;
+  }
+  void *stack = __stack_alloc(&size);
+  if (stack != NULL)
+    live_tasks++;
+  __leave_cs();
+
+  if (stack == NULL) {
+    perror("task_create - mmap");
     return -1;
   }
 
-  makecontext(&(task->context), (void *)start_routine, 1, arg);
+  task->stack = stack;
+  task->stack_size = size;
+  task->body = start_routine;
+  task->arg = arg;
+  context_make(&(task->context), stack, size, __task_entry, task);
 
   task->id = next_task_id++;
   task->start_tick = systime();
   task->activations = 0;
   task->prev = NULL;
   task->next = NULL;
+  task->owner = NULL;
+  task->sleep_index = -1;
   task->prio = 0;
   task->prio_d = 0;
+  task->prio_i = PRIO_NONE;
+  task->held = NULL;
+  task->blocked_on = NULL;
+  task->timed_out = 0;
   task->preemptible = 1;
+  task->detached = 0;
+  queue_head_init(&task->waiting);
 
 #ifdef DEBUG
   printf("task_create: created task %d\n", task->id);
 #endif
 
   if (task != &dispatcher_task) {
-    task->state = READY;
-    queue_append((queue_t **)&queues[READY], (queue_t *)task);
+    __ready_queue_append(task);
   }
 
   return task->id;
@@ -79,11 +118,22 @@ int task_switch(task_t *task) {
   printf("task_switch: changing context %d -> %d\n", previous->id, task->id);
 #endif
 
-  int status = swapcontext(&(previous->context), &(current_task->context));
-  if (status < 0) {
-    perror("task_switch - swapcontext");
-    return status;
-  }
+  // Each task keeps its own critical section depth across the switch; the
+  // one resuming (here or in __task_entry) leaves the section entered here
+  int depth = preemption_disabled;
+  preemption_disabled = 1;
+
+#ifdef TICKLESS
+  // Without ticks, CPU time is measured between switches
+  unsigned long long now = __monotonic_us();
+  previous->cpu_us += now - previous->switch_us;
+  previous->tick_count = previous->cpu_us / 1000;
+  task->switch_us = now;
+#endif
+
+  context_switch(&(previous->context), &(current_task->context));
+  preemption_disabled = depth + 1;
+  __leave_cs();
 
   return 0;
 }
@@ -99,6 +149,7 @@ void task_exit(int exit_code) {
          current_task->tick_count, current_task->activations);
 
   if (current_task == &dispatcher_task) {
+    printf("Idle: idle time %5d ms\n", idle_ticks_count);
     task_switch(&main_task);
     return;
   }
@@ -107,13 +158,11 @@ void task_exit(int exit_code) {
   current_task->exit_code = exit_code;
 
   // Queue up the waiting tasks
-  while (queue_size((queue_t *)current_task->waiting) > 0) {
-    queue_t *task = queue_remove((queue_t **)&current_task->waiting,
-                                 (queue_t *)current_task->waiting);
-    queue_append((queue_t **)&queues[READY], task);
-  }
+  __move_to_ready_queue(&current_task->waiting);
 
-  queue_append((queue_t **)&queues[TERMINATED], (queue_t *)current_task);
+  // The stack can't be released while running on it, so leave that to the
+  // dispatcher, which picks the next task after reaping this one
+  queue_head_append(&queues[TERMINATED], (queue_t *)current_task);
   task_switch(&dispatcher_task);
 }
 
@@ -124,30 +173,96 @@ void task_yield() {
   printf("task_yield: called from task %d\n", current_task->id);
 #endif
   current_task->state = READY;
-  task_switch(&dispatcher_task);
+  __reschedule();
+}
+
+int task_join(task_t *task) { return __task_join(task, WAIT_FOREVER); }
+
+int task_join_try(task_t *task) { return __task_join(task, 0); }
+
+int task_join_timed(task_t *task, int t_ms) {
+  return __task_join(task, t_ms > 0 ? t_ms : 0);
 }
 
-int task_join(task_t *task) {
-  if (task->state == TERMINATED)
+// Waits at most t_ms for the task to end (forever if t_ms is WAIT_FOREVER,
+// not at all if it is 0)
+int __task_join(task_t *task, int t_ms) {
+  if (task == NULL || task->detached)
+    return -1;
+
+  __enter_cs();
+  if (task->state == TERMINATED) {
+    __leave_cs();
     return task->exit_code;
+  }
+
+  if (t_ms == 0) {
+    __leave_cs();
+    return -1;
+  }
 
   current_task->state = WAITING;
-  queue_append((queue_t **)&task->waiting, (queue_t *)current_task);
-  task_switch(&dispatcher_task);
-  return task->exit_code;
+  if (t_ms > 0)
+    __wait_deadline(t_ms);
+  queue_head_append(&task->waiting, (queue_t *)current_task);
+  __reschedule();
+
+  int timed_out = __wait_timed_out();
+  __leave_cs();
+
+  return timed_out ? -1 : task->exit_code;
+}
+
+int task_setfpu(task_t *task, int uses_fpu) {
+  if (task == NULL)
+    task = current_task;
+
+  // A suspended task's frame only holds FP state if it was saved
+  if (task != current_task && task->activations > 0)
+    return -1;
+
+  context_set_fpu(&task->context, uses_fpu);
+  return 0;
+}
+
+int task_detach(task_t *task) {
+  if (task == NULL)
+    task = current_task;
+
+  // Someone is already waiting for it
+  if (task->detached || queue_head_size(&task->waiting) > 0)
+    return -1;
+
+  task->detached = 1;
+  return 0;
 }
 
 void task_setprio(task_t *task, int prio) {
-  if (prio > 19 || prio < -20)
+  if (prio > PRIO_MAX || prio < PRIO_MIN) {
     fprintf(stderr,
-            "task_setprio: invalid priority, must be between -20 and 19");
+            "task_setprio: invalid priority, must be between -20 and 19\n");
+    // The wait and ready queues index their levels by priority
+    prio = prio > PRIO_MAX ? PRIO_MAX : PRIO_MIN;
+  }
 
   if (task == NULL) {
     task = current_task;
   }
 
   task->prio = (short)prio;
-  task->prio_d = (short)prio;
+  task->prio_d = __effective_prio(task);
+
+  // Move it to the queue of its new priority level, or to its new place in
+  // the queue it waits in, and pass the change on to the owner of that
+  __enter_cs();
+  if (task->state == READY && __is_in_another_queue(task)) {
+    __ready_queue_remove(task);
+    __ready_queue_append(task);
+  }
+  __wait_queue_reorder(task);
+  if (task->blocked_on != NULL)
+    __inherit(task->blocked_on->owner);
+  __leave_cs();
 }
 
 int task_getprio(task_t *task) {
@@ -160,46 +275,113 @@ int task_getprio(task_t *task) {
 void task_sleep(int t_ms) {
   current_task->state = SLEEPING;
   current_task->should_wakeup_at = systime() + t_ms;
-  task_switch(&dispatcher_task);
+  __reschedule();
 }
 
-unsigned int systime() { return system_ticks_count; }
+unsigned int systime() {
+#ifdef TICKLESS
+  return (__monotonic_us() - boot_us) / 1000;
+#else
+  return system_ticks_count;
+#endif
+}
 
 task_t *scheduler() {
-  if (queue_size((queue_t *)queues[READY]) == 0) {
+  if (ready_queue.size == 0) {
     return NULL;
   }
 
-  task_t *chosen = (task_t *)queue_reduce((queue_t *)queues[READY], NULL,
-                                          __highest_prio_task);
+  // Every pick ages all ready tasks by SCHEDULER_AGING_ALPHA, so a task's
+  // dynamic priority is its level minus the picks since it was queued.
+  // Each level is FIFO, so only the head of each non-empty level can win.
+  task_t *chosen = NULL;
+  int chosen_prio = 0;
+  unsigned long long levels = ready_queue.bitmap;
+
+  while (levels) {
+    int level = __builtin_ctzll(levels);
+    levels &= levels - 1;
+
+    task_t *head = (task_t *)ready_queue.levels[level].first;
+    int age = (int)(ready_queue.epoch - head->ready_epoch);
+    int prio = level + PRIO_MIN - age * SCHEDULER_AGING_ALPHA;
+
+    // On ties, the task queued first wins
+    if (chosen == NULL || prio < chosen_prio ||
+        (prio == chosen_prio &&
+         (int)(head->ready_epoch - chosen->ready_epoch) < 0)) {
+      chosen = head;
+      chosen_prio = prio;
+    }
+  }
+
+  ready_queue.epoch++;
+  __ready_queue_remove(chosen);
+  chosen->prio_d = __effective_prio(chosen);
+
+  return chosen;
+}
+
+// Gives the processor to task with a fresh quantum
+void __dispatch(task_t *task) {
+  task->tick_budget = DEFAULT_TICK_BUDGET;
+  task->activations += 1;
 
-  queue_foreach((queue_t *)queues[READY], __apply_aging);
+  // A preemption deferred during the previous quantum is void
+  preemption_pending = 0;
 
-  chosen->prio_d = chosen->prio;
+#ifdef TICKLESS
+  task->quantum_end = systime() + DEFAULT_TICK_BUDGET;
+  __program_timer(task);
+#endif
 
-  return (task_t *)queue_remove((queue_t **)&queues[READY], (queue_t *)chosen);
+  if (task != current_task)
+    task_switch(task);
+}
+
+// Called by the running task when it blocks, yields or exits: queues it
+// according to its state and switches straight to the next task, without
+// a round trip through the dispatcher
+void __reschedule() {
+  task_t *task = current_task;
+
+  __enter_cs();
+
+  if (!__is_in_another_queue(task))
+    __queue_by_state(task);
+
+  __queue_up_tasks_that_should_wake_up();
+
+  task_t *next = scheduler();
+  if (next == NULL) {
+    // Let the dispatcher idle until something is ready, or shut down
+    task_switch(&dispatcher_task);
+  } else {
+    __dispatch(next);
+  }
+
+  __leave_cs();
 }
 
 void dispatcher() {
   for (;;) {
+    __reap_terminated_tasks();
+
     int sleeping_tasks = __queue_up_tasks_that_should_wake_up();
-    int waiting_tasks = queue_size((queue_t *)queues[WAITING]);
+    int waiting_tasks = queue_head_size(&queues[WAITING]);
 
     task_t *task = scheduler();
     if (task == NULL) {
       if (sleeping_tasks == 0 && waiting_tasks == 0)
         task_exit(0);
-      else
-        continue;
-    }
-
-    task->tick_budget = DEFAULT_TICK_BUDGET;
-    task->activations += 1;
 
-    task_switch(task);
+      __idle();
+      continue;
+    }
 
-    if (!__is_in_another_queue(task))
-      queue_append((queue_t **)&queues[task->state], (queue_t *)task);
+    // Tasks hand the processor directly to each other from now on; the
+    // dispatcher only runs again when nothing is ready
+    __dispatch(task);
 
     dispatcher_task.activations++;
   }
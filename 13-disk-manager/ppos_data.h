@@ -7,65 +7,158 @@
 #ifndef __PPOS_DATA__
 #define __PPOS_DATA__
 
-#include "queue.h"    // biblioteca de filas genéricas
-#include <ucontext.h> // biblioteca POSIX de trocas de contexto
+#include "ppos_context.h" // trocas de contexto
+#include "queue.h"        // biblioteca de filas genéricas
+#include <stdint.h>
 
 typedef enum { READY, WAITING, SLEEPING, TERMINATED } state_t;
 
-// Estrutura que define um Task Control Block (TCB)
+// faixa de prioridades (menor valor = maior prioridade)
+#define PRIO_MIN -20
+#define PRIO_MAX 19
+#define PRIO_LEVELS (PRIO_MAX - PRIO_MIN + 1)
+#define PRIO_NONE (PRIO_MAX + 1) // nenhuma prioridade herdada
+
+// opções de criação de semáforos e mutexes (sem_create_opt, mutex_create_opt)
+#define SEM_BINARY 0x1 // valor limitado a 1, com herança de prioridade
+#define WAKE_PRIO 0x2  // acorda primeiro quem tem maior prioridade
+
+// recurso pelo qual tarefas esperam (mutex ou semáforo). Com herança de
+// prioridade (mutex ou semáforo binário), enquanto há tarefas esperando, a
+// dona herda a maior prioridade entre elas. Com WAKE_PRIO, a fila de espera
+// fica ordenada por prioridade, em ordem de chegada dentro de cada nível.
+typedef struct inheritance_t {
+  struct task_t *owner;       // tarefa dona do recurso (NULL se nenhuma)
+  queue_head_t *waiting;      // tarefas aguardando o recurso
+  struct inheritance_t *next; // próximo recurso disputado da mesma dona
+  short linked;               // se está na lista de recursos da dona
+  short wake_prio;            // fila de espera ordenada por prioridade
+  unsigned long long levels;  // bit i ligado se há espera no nível i
+} inheritance_t;
+
+// tamanho de uma linha de cache, em bytes
+#define CACHE_LINE 64
+
+// Estrutura que define um Task Control Block (TCB). Os campos usados pelas
+// filas e pelo escalonador ficam juntos na primeira linha de cache; contexto
+// e contabilização, usados só nas trocas de contexto, ficam depois.
 typedef struct task_t {
+  // campos quentes (filas, escalonamento, heap de tarefas dormindo)
   struct task_t *prev, *next; // ponteiros para usar em filas
-  int id;                     // identificador da tarefa
-  ucontext_t context;         // contexto armazenado da tarefa
+  queue_head_t *owner;        // fila onde a tarefa está (NULL se nenhuma)
   state_t state;              // estado atual da tarefa
   short prio;                 // prioridade estática da tarefa
   short prio_d;      // prioridade dinâmica da tarefa (afetada pelo aging)
+  short prio_i;      // prioridade herdada (PRIO_NONE se nenhuma)
   short preemptible; // indica se a tarefa é preemptável
+  short detached;    // não pode ser aguardada (task_detach)
+  unsigned int ready_epoch; // época em que entrou na fila de prontas
   unsigned int tick_budget; // quantidade de ticks disponíveis
-  unsigned int tick_count;  // contagem de ticks disponíveis
+  unsigned int should_wakeup_at;
+  int sleep_index; // posição no heap de tarefas dormindo (-1 se não)
+  int id;          // identificador da tarefa
+
+  // campos frios (contexto e contabilização)
+  context_t context;    // contexto armazenado da tarefa
+  void (*body)(void *); // função corpo da tarefa
+  void *arg;            // argumento da função corpo
+  void *stack;          // pilha da tarefa (do pool de pilhas)
+  size_t stack_size;    // tamanho da pilha, em bytes
+  unsigned int tick_count; // contagem de ticks disponíveis
   unsigned int activations;
   unsigned int start_tick;
-  unsigned int should_wakeup_at;
-  struct task_t *waiting;
+  unsigned int quantum_end; // fim do quantum atual, em ms (modo TICKLESS)
+  unsigned long long switch_us; // último instante em que recebeu a CPU (us)
+  unsigned long long cpu_us;    // tempo de CPU acumulado, em us (TICKLESS)
+  queue_head_t waiting; // tarefas aguardando o término desta (task_join)
   int exit_code;
+  inheritance_t *held;       // recursos disputados que a tarefa detém
+  inheritance_t *blocked_on; // recurso pelo qual a tarefa espera
+  short wait_prio; // prioridade com que está na fila de espera (WAKE_PRIO)
+  short timed_out; // a última espera com prazo (_timed) expirou
 
-} task_t;
+} __attribute__((aligned(CACHE_LINE))) task_t;
+
+// fila de tarefas prontas: uma fila por nível de prioridade e um bitmap
+// dos níveis não vazios. O envelhecimento (aging) é calculado a partir da
+// época de entrada de cada tarefa, sem percorrer as tarefas prontas.
+typedef struct {
+  queue_head_t levels[PRIO_LEVELS];
+  unsigned long long bitmap; // bit i ligado se levels[i] não está vazio
+  unsigned int epoch;        // número de escolhas feitas pelo escalonador
+  int size;
+} ready_queue_t;
+
+// tarefas dormindo, e esperando com prazo (_timed): heap binário mínimo
+// ordenado por should_wakeup_at, de modo que a próxima a acordar está sempre
+// em tasks[0]
+typedef struct {
+  struct task_t **tasks;
+  int size;
+  int capacity;
+} sleep_queue_t;
 
 // estrutura que define um semáforo
 typedef struct {
   int value;
-  short lock;
   short is_destroyed;
-  struct task_t *waiting;
-  // preencher quando necessário
+  short binary; // valor limitado a 1, com herança de prioridade
+  queue_head_t waiting;
+  inheritance_t inheritance; // dona: última tarefa que obteve o semáforo
 } semaphore_t;
 
 // estrutura que define um mutex
 typedef struct {
-  // preencher quando necessário
+  uintptr_t state;      // tarefa dona (0 = livre), com bit de contenção
+  short is_destroyed;
+  queue_head_t waiting; // tarefas aguardando o mutex
+  inheritance_t inheritance; // usado só enquanto há disputa
 } mutex_t;
 
-// estrutura que define uma barreira
+// estrutura que define uma barreira; rearma-se sozinha a cada geração
 typedef struct {
-  // preencher quando necessário
-  struct task_t *waiting;
-  semaphore_t mutex;
-  int current_count;
-  int expected_count;
+  queue_head_t waiting;    // tarefas aguardando a geração atual
+  int current_count;       // tarefas que já chegaram na geração atual
+  int expected_count;      // tarefas que liberam a barreira
+  unsigned int generation; // gerações já liberadas
+  short is_destroyed;
+  void (*leader)(void *); // executada pela última a chegar (ou NULL)
+  void *leader_arg;
 } barrier_t;
 
-// estrutura que define uma fila de mensagens
+// opções de criação de filas de mensagens (mqueue_create_opt)
+#define MQUEUE_SPSC 0x1 // um só produtor e um só consumidor, sem travas
+#define MQUEUE_VAR 0x2  // mensagens de tamanho variável num anel de bytes
+
+// estrutura que define uma fila de mensagens. A partir de released, o anel
+// tem as posições emprestadas a quem recebe (reading), as mensagens prontas
+// (length), as posições reservadas por quem envia (writing) e as livres.
+// Com MQUEUE_VAR, o anel tem capacity bytes e cada mensagem ocupa um int com
+// seu tamanho seguido dos dados, que podem dar a volta no anel; prod_sem
+// conta bytes livres, e head e tail são posições em bytes.
 typedef struct {
-  semaphore_t mutex;
-  semaphore_t prod_sem;
-  semaphore_t cons_sem;
+  semaphore_t prod_sem; // posições livres
+  semaphore_t cons_sem; // mensagens prontas
   char *buffer;
+  char *done; // posição já entregue (commit) ou liberada (release)
   short is_destroyed;
-  int msg_size;
+  int msg_size; // com MQUEUE_VAR, o tamanho máximo de uma mensagem
   int capacity;
-  int length;
-  int head;
-  int tail;
+  int length;    // mensagens prontas para receber
+  int writing;   // posições reservadas, ainda sem commit
+  int reading;   // posições emprestadas, ainda sem release
+  int head;      // próxima posição a reservar
+  int committed; // primeira posição reservada
+  int tail;      // próxima mensagem a receber
+  int released;  // primeira posição emprestada
+  short spsc;    // um só produtor e um só consumidor (MQUEUE_SPSC)
+  short prod_waiting; // SPSC: produtor bloqueado com a fila cheia
+  short cons_waiting; // SPSC: consumidor bloqueado com a fila vazia
+  unsigned int put;   // SPSC: mensagens já escritas (contador livre)
+  unsigned int got;   // SPSC: mensagens já lidas (contador livre)
+  short var;            // mensagens de tamanho variável (MQUEUE_VAR)
+  semaphore_t send_sem; // VAR: um remetente por vez
+  semaphore_t recv_sem; // VAR: um destinatário por vez
 } mqueue_t;
 
 #endif
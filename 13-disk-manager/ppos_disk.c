@@ -22,21 +22,19 @@ void diskManagerBody(void *arg) {
     sem_down(&disk.mutex);
 
     if (disk.signal_fired) {
-      task_t *request_by =
-          (task_t *)queue_remove((queue_t **)&queues[WAITING],
-                                 (queue_t *)disk.current_request->requested_by);
-      queue_append((queue_t **)&queues[READY], (queue_t *)request_by);
+      task_t *request_by = (task_t *)queue_head_unlink(
+          &queues[WAITING], (queue_t *)disk.current_request->requested_by);
+      __ready_queue_append(request_by);
 
-      // Clean up
-      free(disk.current_request);
+      disk.current_request = NULL;
       disk.signal_fired = 0;
     }
 
-    int disk_idle = disk_cmd(DISK_CMD_STATUS, 0, 0) == DISK_STATUS_IDLE;
-
-    if (disk_idle && disk.queue != NULL) {
-      disk.current_request = (disk_request_t *)queue_remove(
-          (queue_t **)&disk.queue, (queue_t *)disk.queue);
+    // The disk goes idle before raising its signal, so only the request
+    // tells whether the last operation was handled
+    if (disk.current_request == NULL && queue_head_size(&disk.queue) > 0) {
+      disk.current_request = (disk_request_t *)queue_head_unlink(
+          &disk.queue, disk.queue.first);
 
       int cmd;
       if (disk.current_request->type == READ) {
@@ -49,7 +47,18 @@ void diskManagerBody(void *arg) {
     }
 
     sem_up(&disk.mutex);
-    task_yield();
+
+    // Nothing to do until the disk signals or a request comes in: leave
+    // the ready queue, so the dispatcher can idle, and let
+    // __wake_up_manager queue the manager again. Inside the section, the
+    // disk signal's wakeup is deferred until the manager is queued.
+    __enter_cs();
+    if (!disk.signal_fired &&
+        (disk.current_request != NULL || queue_head_size(&disk.queue) == 0)) {
+      current_task->state = WAITING;
+      __reschedule();
+    }
+    __leave_cs();
   }
 }
 
@@ -62,6 +71,7 @@ int disk_mgr_init(int *num_blocks, int *block_size) {
 
   check(__setup_signal_handler());
   check(sem_create(&disk.mutex, 1));
+  queue_head_init(&disk.queue);
 
   // Create disk manager task
   task_create(&disk_manager, (void *)diskManagerBody, NULL);
@@ -78,24 +88,26 @@ int disk_block_read(int block, void *buffer) {
   printf("Read request for block %d\n", block);
 #endif
 
-  // Create disk request
-  sem_down(&disk.mutex);
-  disk_request_t *request = malloc(sizeof(disk_request_t));
-  request->prev = NULL;
-  request->next = NULL;
-  request->requested_by = current_task;
-  request->block = block;
-  request->buffer = buffer;
+  // The task waits for the request to complete, so it lives on its stack;
+  // malloc is not safe to call from preemptible code
+  disk_request_t request = {0};
+  request.requested_by = current_task;
+  request.block = block;
+  request.buffer = buffer;
+  request.type = READ;
 
-  queue_append((queue_t **)&disk.queue, (queue_t *)request);
+  sem_down(&disk.mutex);
+  queue_head_append(&disk.queue, (queue_t *)&request);
 
   __wake_up_manager();
 
+  // Not preemptible from here on, so it is in queues[WAITING] before the
+  // manager can look for it there
+  current_task->state = WAITING;
   sem_up(&disk.mutex);
 
   // Suspend current task
-  current_task->state = WAITING;
-  task_switch(&dispatcher_task);
+  __reschedule();
 
   return 0;
 }
@@ -103,10 +115,8 @@ int disk_block_read(int block, void *buffer) {
 int disk_block_write(int block, void *buffer) { return 0; }
 
 void __handle_disk_signal() {
-  sem_down(&disk.mutex);
   disk.signal_fired = 1;
-  __wake_up_manager();
-  sem_up(&disk.mutex);
+  __run_or_defer(__wake_up_manager);
 }
 
 int __setup_signal_handler() {
@@ -121,7 +131,12 @@ int __setup_signal_handler() {
 }
 
 void __wake_up_manager() {
-  if (disk_manager.prev == NULL && disk_manager.next == NULL) {
-    queue_append((queue_t **)&queues[READY], (queue_t *)&disk_manager);
+  __enter_cs();
+  if (disk_manager.state == WAITING && disk_manager.owner == &queues[WAITING])
+    queue_head_unlink(&queues[WAITING], (queue_t *)&disk_manager);
+
+  if (!__is_in_another_queue(&disk_manager)) {
+    __ready_queue_append(&disk_manager);
   }
+  __leave_cs();
 }
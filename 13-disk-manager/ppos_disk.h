@@ -15,6 +15,7 @@ typedef enum { READ, WRITE } request_type_t;
 
 typedef struct {
   struct disk_request *prev, *next;
+  queue_head_t *owner;
   int block;
   void *buffer;
   task_t *requested_by;
@@ -24,7 +25,7 @@ typedef struct {
 // estrutura que representa um disco no sistema operacional
 typedef struct {
   disk_request_t *current_request;
-  disk_request_t *queue;
+  queue_head_t queue;
   semaphore_t mutex;
   short signal_fired;
 } disk_t;
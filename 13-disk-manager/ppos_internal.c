@@ -1,114 +1,352 @@
 #include "ppos_internal.h"
 #include "ppos.h"
 #include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
 
-void __wake_up_first_waiting_task(semaphore_t *s) {
-  queue_append((queue_t **)&queues[READY],
-               queue_remove((queue_t **)&s->waiting, (queue_t *)s->waiting));
+#ifdef TICKLESS
+unsigned long long idle_us_count = 0;
+#endif
+
+task_t *__wake_up_first_waiting_task(semaphore_t *s) {
+  task_t *task = (task_t *)s->waiting.first;
+  __wait_queue_unlink(&s->inheritance, task);
+  __wait_deadline_cancel(task);
+  __ready_queue_append(task);
+  return task;
 }
 
 void __wake_up_first__task(queue_t *q) {
-  queue_append((queue_t **)&queues[READY],
-               queue_remove((queue_t **)&q, (queue_t *)q));
+  __ready_queue_append((task_t *)queue_remove(&q, q));
 };
 
-void __move_to_ready_queue(task_t *queue) {
-  int num_of_tasks = queue_size((queue_t *)queue);
+// Moves every task in the queue to the ready queue. Each run of tasks
+// bound to the same priority level is spliced into it as a whole.
+void __move_to_ready_queue(queue_head_t *queue) {
+  __enter_cs();
+  while (queue_head_size(queue) > 0) {
+    task_t *last = (task_t *)queue->first;
+    int level = __ready_level(last);
+    int count = 0;
 
-  if (num_of_tasks == 0)
-    return;
+    for (;;) {
+      __wait_deadline_cancel(last);
+      last->state = READY;
+      last->ready_epoch = ready_queue.epoch;
+      count++;
+      if (count == queue_head_size(queue) || __ready_level(last->next) != level)
+        break;
+      last = last->next;
+    }
 
-  task_t *task = queue;
-  for (int i = 0; i < num_of_tasks; i++) {
-    task_t *next = task->next;
-    queue_remove((queue_t **)&queue, (queue_t *)task);
-    queue_append((queue_t **)&queues[READY], (queue_t *)task);
-    task = next;
+    queue_head_splice(&ready_queue.levels[level], queue, (queue_t *)last,
+                      count);
+    ready_queue.bitmap |= 1ULL << level;
+    ready_queue.size += count;
   }
+  __leave_cs();
 }
 
-// Return the task with the highest priority
-void *__highest_prio_task(void *prev, void *next) {
-  if (prev == NULL)
-    return next;
+// First function run by every task created by task_create
+void __task_entry(void *arg) {
+  task_t *task = (task_t *)arg;
 
-  task_t *prev_task = (task_t *)prev;
-  task_t *next_task = (task_t *)next;
+  // The task that switched here left a critical section open
+  __leave_cs();
 
-  if (next_task->prio_d < prev_task->prio_d) {
-    return next;
-  }
+  task->body(task->arg);
+}
 
-  return prev;
+// Puts a task that is not in any queue in the one for its state
+void __queue_by_state(task_t *task) {
+  if (task->state == READY)
+    __ready_queue_append(task);
+  else if (task->state == SLEEPING)
+    __sleep_queue_insert(task);
+  else
+    queue_head_append(&queues[task->state], (queue_t *)task);
 }
 
-// Apply the aging factor on tasks
-void __apply_aging(void *ptr) {
-  task_t *task = (task_t *)ptr;
-  task->prio_d -= SCHEDULER_AGING_ALPHA;
+// Ready queue level of the task's current dynamic priority
+int __ready_level(task_t *task) {
+  int level = task->prio_d;
+  if (level < PRIO_MIN)
+    level = PRIO_MIN;
+  if (level > PRIO_MAX)
+    level = PRIO_MAX;
+  return level - PRIO_MIN;
 }
 
-void __set_up_and_queue_main_task() {
-  getcontext(&(main_task.context));
+// Queues the task on the level of its current dynamic priority
+void __ready_queue_append(task_t *task) {
+  int level = __ready_level(task);
+
+  // Signal handlers queue tasks too (see __run_or_defer)
+  __enter_cs();
+  task->state = READY;
+  task->ready_epoch = ready_queue.epoch;
+  queue_head_append(&ready_queue.levels[level], (queue_t *)task);
+  ready_queue.bitmap |= 1ULL << level;
+  ready_queue.size++;
+  __leave_cs();
+}
+
+void __ready_queue_remove(task_t *task) {
+  __enter_cs();
+  queue_head_t *level = task->owner;
+  queue_head_unlink(level, (queue_t *)task);
+  if (queue_head_size(level) == 0)
+    ready_queue.bitmap &= ~(1ULL << (level - ready_queue.levels));
+  ready_queue.size--;
+  __leave_cs();
+}
 
+void __set_up_and_queue_main_task() {
   main_task.id = 0;
   main_task.next = NULL;
   main_task.prev = NULL;
+  main_task.owner = NULL;
+  main_task.sleep_index = -1;
   main_task.start_tick = systime();
+  main_task.switch_us = __monotonic_us();
   main_task.activations = 0;
   main_task.prio = 0;
   main_task.prio_d = 0;
+  main_task.prio_i = PRIO_NONE;
+  main_task.held = NULL;
+  main_task.blocked_on = NULL;
+  main_task.timed_out = 0;
   main_task.preemptible = 1;
+  main_task.detached = 0;
+  main_task.stack = NULL;
+  context_set_fpu(&main_task.context, 1);
   main_task.state = READY;
+  queue_head_init(&main_task.waiting);
 
-  queue_append((queue_t **)&queues[READY], (queue_t *)&main_task);
+  __ready_queue_append(&main_task);
 }
 
-void __enter_sem_cs(semaphore_t *s) {
-#ifdef DEBUG
-  printf("Task %d is waiting\n", current_task->id);
-#endif
-  // Busy waiting
-  while (__sync_fetch_and_or(&(s->lock), 1))
-    ;
-#ifdef DEBUG
-  printf("Task %d got the lock\n", current_task->id);
-#endif
+// Kernel critical sections. Inside one, the timer never preempts the
+// current task and signal handlers don't touch kernel data: they leave
+// their work pending, and it runs when the outermost section is left.
+// Sections nest, and a task may block inside one (see task_switch).
+void __enter_cs() { preemption_disabled++; }
+
+void __leave_cs() {
+  if (--preemption_disabled > 0)
+    return;
+
+  if (deferred_work != NULL) {
+    void (*work)() = deferred_work;
+    deferred_work = NULL;
+    work();
+  }
+
+  if (preemption_pending) {
+    preemption_pending = 0;
+    if (__can_preempt())
+      task_yield();
+  }
+}
+
+// Used by signal handlers for work that changes kernel data. It never
+// switches tasks: the handler may be nested in others (like the disk's
+// SIGIO), whose signals would stay blocked while the task is away.
+void __run_or_defer(void (*work)()) {
+  if (preemption_disabled) {
+    deferred_work = work;
+    return;
+  }
+
+  preemption_disabled++;
+  work();
+  preemption_disabled--;
 }
 
-void __leave_sem_cs(semaphore_t *s) {
-#ifdef DEBUG
-  printf("Task %d released the lock \n", current_task->id);
+// Called by the timer handler when the current task's quantum is over
+void __preempt() {
+  if (preemption_disabled) {
+    preemption_pending = 1;
+    return;
+  }
+
+  // The timer interrupted the disk's handlers, whose signals would stay
+  // blocked in every task run until this one resumes. Try again later: the
+  // budget stays at zero, so the next tick preempts.
+  if (__kernel_signals_blocked()) {
+#ifdef TICKLESS
+    __program_timer(current_task);
 #endif
-  s->lock = 0;
+    return;
+  }
+
+  __unblock_signal(SIGALRM);
+  task_yield();
 }
 
 void __create_dispatcher_task() {
   task_create(&dispatcher_task, (void *)dispatcher, NULL);
   dispatcher_task.preemptible = 0;
+  context_set_fpu(&dispatcher_task.context, 0);
   dispatcher_task.tick_count = 0;
   dispatcher_task.activations = 0;
   dispatcher_task.start_tick = systime();
 }
 
+// A task that already changed its state is about to block, and will call
+// __reschedule itself; preempting it now would turn it back into READY
+int __can_preempt() {
+  return current_task->preemptible && current_task->state == READY;
+}
+
 void __timer_tick_handler() {
+#ifdef TICKLESS
+  // The timer only fires when the quantum ends or a sleeper is due; either
+  // way the dispatcher has to run. While idle, sigsuspend just returns.
+  if (is_idle || !__can_preempt())
+    return;
+
+  // Inside a critical section the sleep heap may be changing, so don't look
+  if (preemption_disabled ||
+      systime() >= current_task->quantum_end ||
+      (sleep_queue.size > 0 &&
+       sleep_queue.tasks[0]->should_wakeup_at <= systime())) {
+    __preempt();
+    return;
+  }
+
+  // Early or stale signal: wait for whatever is due next
+  __program_timer(current_task);
+#else
   system_ticks_count++;
+
+  if (is_idle) {
+    idle_ticks_count++;
+    return;
+  }
+
   current_task->tick_count++;
 
-  if (!current_task->preemptible)
+  if (!__can_preempt())
     return;
 
-  current_task->tick_budget -= 1;
+  // The budget stays at zero while a preemption is deferred
+  if (current_task->tick_budget > 0)
+    current_task->tick_budget -= 1;
 
-  if (current_task->tick_budget == 0) {
-    task_yield();
+  if (current_task->tick_budget == 0)
+    __preempt();
+#endif
+}
+
+// A task preempted from a signal handler leaves with the signal blocked.
+// context_switch does not restore signal masks (unlike swapcontext), so
+// the signal is unblocked before switching away; sigreturn restores the
+// task's own mask once it resumes and leaves the handler.
+void __unblock_signal(int signum) {
+#ifdef CONTEXT_ASM
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, signum);
+  sigprocmask(SIG_UNBLOCK, &signals, NULL);
+#endif
+}
+
+// Tells whether a kernel signal other than SIGALRM is blocked, which means a
+// handler of the disk is running (with swapcontext, each task keeps its own
+// mask, so switching is always safe)
+int __kernel_signals_blocked() {
+#ifdef CONTEXT_ASM
+  sigset_t mask;
+  sigprocmask(SIG_BLOCK, NULL, &mask);
+  return sigismember(&mask, SIGIO) || sigismember(&mask, SIGUSR1);
+#else
+  return 0;
+#endif
+}
+
+// Blocks the dispatcher until the next timer tick or disk signal
+void __idle() {
+  sigset_t signals, old_mask;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGALRM);
+  sigaddset(&signals, SIGUSR1);
+
+  // With the signals blocked, nothing can become ready between the check
+  // below and sigsuspend, which unblocks them atomically
+  sigprocmask(SIG_BLOCK, &signals, &old_mask);
+
+  if (ready_queue.size == 0 &&
+      (sleep_queue.size == 0 ||
+       sleep_queue.tasks[0]->should_wakeup_at > systime())) {
+#ifdef TICKLESS
+    __program_timer(NULL);
+    unsigned long long start = __monotonic_us();
+#endif
+
+    is_idle = 1;
+    sigsuspend(&old_mask);
+    is_idle = 0;
+
+#ifdef TICKLESS
+    // Idle time is not dispatcher CPU time
+    unsigned long long idle_us = __monotonic_us() - start;
+    dispatcher_task.switch_us += idle_us;
+    idle_us_count += idle_us;
+    idle_ticks_count = idle_us_count / 1000;
+#endif
   }
+
+  sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+// Arms a one-shot timer for the earlier of the task's quantum end and the
+// earliest sleep deadline. task is NULL when the dispatcher goes idle.
+void __program_timer(task_t *task) {
+  long long next_ms = -1;
+
+  if (task != NULL && task->preemptible)
+    next_ms = task->quantum_end;
+
+  if (sleep_queue.size > 0 &&
+      (next_ms < 0 || sleep_queue.tasks[0]->should_wakeup_at < next_ms))
+    next_ms = sleep_queue.tasks[0]->should_wakeup_at;
+
+  // A zeroed it_value disarms the timer
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = 0;
+  timer.it_value.tv_sec = 0;
+  timer.it_value.tv_usec = 0;
+
+  if (next_ms >= 0) {
+    long long now_us = __monotonic_us() - boot_us;
+    long long delay_us = next_ms * 1000 - now_us;
+    if (delay_us < 1)
+      delay_us = 1;
+    timer.it_value.tv_sec = delay_us / 1000000;
+    timer.it_value.tv_usec = delay_us % 1000000;
+  }
+
+  if (setitimer(ITIMER_REAL, &timer, 0) < 0) {
+    perror("setitimer");
+    exit(1);
+  }
+}
+
+unsigned long long __monotonic_us() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
 }
 
 void __set_up_timer() {
+#ifdef TICKLESS
+  // Armed on demand by __program_timer
+  boot_us = __monotonic_us();
+#else
   timer.it_value.tv_usec = 1000; // First tick, in micro-seconds
   timer.it_value.tv_sec = 0;     // in seconds
 
@@ -120,6 +358,7 @@ void __set_up_timer() {
     perror("setitimer");
     exit(1);
   }
+#endif
 }
 
 void __set_up_signals() {
@@ -133,36 +372,371 @@ void __set_up_signals() {
 }
 
 unsigned int __queue_up_tasks_that_should_wake_up() {
-  int sleeping_tasks;
-  if ((sleeping_tasks = queue_size((queue_t *)queues[SLEEPING])) <= 0) {
-    return 0;
+  // Only the earliest deadline needs to be checked
+  while (sleep_queue.size > 0 &&
+         sleep_queue.tasks[0]->should_wakeup_at <= systime()) {
+    task_t *task = sleep_queue.tasks[0];
+    __sleep_queue_remove(task);
+    if (task->state == WAITING)
+      __wait_expire(task);
+    __ready_queue_append(task);
   }
 
-  int still_sleeping = 0;
+  return sleep_queue.size;
+}
 
-  task_t *task = queues[SLEEPING];
-  for (int i = 0; i < sleeping_tasks; i++) {
-    task_t *next = task->next;
-    if (task->should_wakeup_at <= systime()) {
-      queue_remove((queue_t **)&queues[SLEEPING], (queue_t *)task);
-      queue_append((queue_t **)&queues[READY], (queue_t *)task);
-    } else {
-      still_sleeping += 1;
-    }
-    task = next;
+// Moves the task at index i up the heap until its parent wakes up earlier
+void __sleep_queue_sift_up(int i) {
+  task_t **tasks = sleep_queue.tasks;
+  task_t *task = tasks[i];
+
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (tasks[parent]->should_wakeup_at <= task->should_wakeup_at)
+      break;
+    tasks[i] = tasks[parent];
+    tasks[i]->sleep_index = i;
+    i = parent;
+  }
+
+  tasks[i] = task;
+  task->sleep_index = i;
+}
+
+// Moves the task at index i down the heap until its children wake up later
+void __sleep_queue_sift_down(int i) {
+  task_t **tasks = sleep_queue.tasks;
+  task_t *task = tasks[i];
+
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= sleep_queue.size)
+      break;
+    if (child + 1 < sleep_queue.size &&
+        tasks[child + 1]->should_wakeup_at < tasks[child]->should_wakeup_at)
+      child++;
+    if (task->should_wakeup_at <= tasks[child]->should_wakeup_at)
+      break;
+    tasks[i] = tasks[child];
+    tasks[i]->sleep_index = i;
+    i = child;
   }
 
-  return still_sleeping;
+  tasks[i] = task;
+  task->sleep_index = i;
 }
 
-unsigned short __is_in_another_queue(task_t *t) {
-  if (t->next == NULL && t->prev == NULL)
+// Makes room for n sleeping tasks. Called from task_create, so the
+// dispatcher never allocates while a preempted task may be inside malloc.
+int __sleep_queue_reserve(int n) {
+  if (n <= sleep_queue.capacity)
     return 0;
-  return 1;
+
+  int capacity = sleep_queue.capacity ? sleep_queue.capacity : 64;
+  while (capacity < n)
+    capacity *= 2;
+
+  task_t **tasks = realloc(sleep_queue.tasks, capacity * sizeof(task_t *));
+  if (tasks == NULL)
+    return -1;
+
+  sleep_queue.tasks = tasks;
+  sleep_queue.capacity = capacity;
+  return 0;
 }
 
+void __sleep_queue_insert(task_t *task) {
+  sleep_queue.tasks[sleep_queue.size] = task;
+  __sleep_queue_sift_up(sleep_queue.size++);
+}
+
+void __sleep_queue_remove(task_t *task) {
+  int i = task->sleep_index;
+  task_t *last = sleep_queue.tasks[--sleep_queue.size];
+  task->sleep_index = -1;
+
+  if (last == task)
+    return;
+
+  // Fill the hole with the last task and restore the heap order
+  sleep_queue.tasks[i] = last;
+  last->sleep_index = i;
+  if (i > 0 && sleep_queue.tasks[(i - 1) / 2]->should_wakeup_at >
+                   last->should_wakeup_at)
+    __sleep_queue_sift_up(i);
+  else
+    __sleep_queue_sift_down(i);
+}
+
+// Gives the stacks of terminated tasks back to the pool. Their descriptors
+// are kept, so task_join still returns the exit code. Must not be called on
+// the stack of a task that is in queues[TERMINATED].
+void __reap_terminated_tasks() {
+  queue_head_t *terminated = &queues[TERMINATED];
+
+  while (queue_head_size(terminated) > 0) {
+    task_t *task = (task_t *)queue_head_unlink(terminated, terminated->first);
+    if (task->stack == NULL)
+      continue;
+
+    __stack_release(task->stack, task->stack_size);
+    task->stack = NULL;
+    live_tasks--;
+  }
+}
+
+unsigned short __is_in_another_queue(task_t *t) { return t->owner != NULL; }
+
+// Without an owner (any semaphore but a binary one) nothing is inherited,
+// but blocked_on still lets a change of priority reorder the queue
 void __wait_in_semaphore_queue(semaphore_t *s) {
   current_task->state = WAITING;
-  queue_append((queue_t **)&s->waiting, (queue_t *)current_task);
-  task_yield();
+  __wait_queue_insert(&s->inheritance, current_task);
+  __inheritance_block(&s->inheritance);
+  __reschedule();
+  current_task->blocked_on = NULL;
+}
+
+/*
+ * Timed waits
+ *
+ * A task waiting with a deadline (the _timed calls) is both in the queue of
+ * what it waits for and in the sleep heap. Whichever ends the wait takes it
+ * out of the other: a wakeup finds it in the heap by its sleep_index, and
+ * the deadline unlinks it from the waiting queue through its owner.
+ */
+
+// Called by the current task, inside a critical section, right before it
+// blocks
+void __wait_deadline(int t_ms) {
+  current_task->should_wakeup_at = systime() + t_ms;
+  current_task->timed_out = 0;
+  __sleep_queue_insert(current_task);
+}
+
+// A waiting task was woken up: its deadline, if any, no longer applies
+void __wait_deadline_cancel(task_t *task) {
+  if (task->sleep_index >= 0)
+    __sleep_queue_remove(task);
+}
+
+// The deadline of a waiting task passed, so it leaves the waiting queue as
+// if it had never come. Only semaphores (sem_down_timed) and tasks
+// (task_join_timed) are waited for with a deadline; a semaphore gets back
+// the unit the task took from its value.
+void __wait_expire(task_t *task) {
+  inheritance_t *r = task->blocked_on;
+
+  if (r != NULL) {
+    semaphore_t *s =
+        (semaphore_t *)((char *)r - offsetof(semaphore_t, inheritance));
+    __wait_queue_unlink(r, task);
+    s->value += 1;
+    task->blocked_on = NULL;
+    __inherit(r->owner);
+  } else {
+    queue_head_unlink(task->owner, (queue_t *)task);
+  }
+
+  task->timed_out = 1;
+}
+
+// Whether the current task's last wait ended by its deadline
+int __wait_timed_out() {
+  int timed_out = current_task->timed_out;
+  current_task->timed_out = 0;
+  return timed_out;
+}
+
+// Milliseconds left of a wait of t_ms that ends at deadline (WAIT_FOREVER
+// if it has none)
+int __time_left(int t_ms, unsigned int deadline) {
+  if (t_ms < 0)
+    return WAIT_FOREVER;
+
+  int left = (int)(deadline - systime());
+  return left > 0 ? left : 0;
+}
+
+/*
+ * Wait queues
+ *
+ * A resource created with WAKE_PRIO keeps its waiting queue sorted by
+ * priority, in arrival order within each level, so the first task is
+ * always the one to wake up. The levels bitmap tells which priorities are
+ * in the queue: a task of the lowest one queued just goes to the end.
+ */
+
+void __wait_queue_insert(inheritance_t *r, task_t *task) {
+  if (!r->wake_prio) {
+    queue_head_append(r->waiting, (queue_t *)task);
+    return;
+  }
+
+  int prio = __effective_prio(task);
+  int level = prio - PRIO_MIN;
+  unsigned long long higher_or_equal = (2ULL << level) - 1;
+  task->wait_prio = prio;
+
+  if ((r->levels & ~higher_or_equal) == 0) {
+    queue_head_append(r->waiting, (queue_t *)task);
+  } else if ((r->levels & higher_or_equal) == 0) {
+    queue_head_insert_after(r->waiting, NULL, (queue_t *)task);
+  } else {
+    // Skip the lower priority tasks at the end of the queue
+    task_t *pos = (task_t *)r->waiting->first->prev;
+    while (pos->wait_prio > prio)
+      pos = pos->prev;
+    queue_head_insert_after(r->waiting, (queue_t *)pos, (queue_t *)task);
+  }
+
+  r->levels |= 1ULL << level;
+}
+
+void __wait_queue_unlink(inheritance_t *r, task_t *task) {
+  if (!r->wake_prio) {
+    queue_head_unlink(r->waiting, (queue_t *)task);
+    return;
+  }
+
+  // Tasks of the same level are next to each other
+  task_t *first = (task_t *)r->waiting->first;
+  short prio = task->wait_prio;
+  int shared = (task != first && task->prev->wait_prio == prio) ||
+               (task->next != first && task->next->wait_prio == prio);
+
+  queue_head_unlink(r->waiting, (queue_t *)task);
+  if (!shared)
+    r->levels &= ~(1ULL << (prio - PRIO_MIN));
+}
+
+// Moves a task waiting on a WAKE_PRIO resource to the place of its current
+// priority
+void __wait_queue_reorder(task_t *task) {
+  inheritance_t *r = task->blocked_on;
+
+  if (task->state != WAITING || r == NULL || !r->wake_prio ||
+      task->owner != r->waiting || task->wait_prio == __effective_prio(task))
+    return;
+
+  __wait_queue_unlink(r, task);
+  __wait_queue_insert(r, task);
+}
+
+/*
+ * Priority inheritance
+ *
+ * A task holding a contended mutex or binary semaphore runs with the
+ * highest priority among the tasks waiting for it, and passes it on to the
+ * owner of whatever it is waiting for itself. Everything here runs inside
+ * a kernel critical section.
+ */
+
+int __effective_prio(task_t *task) {
+  return task->prio_i < task->prio ? task->prio_i : task->prio;
+}
+
+void __inheritance_init(inheritance_t *r, queue_head_t *waiting, int options) {
+  r->owner = NULL;
+  r->waiting = waiting;
+  r->next = NULL;
+  r->linked = 0;
+  r->wake_prio = (options & WAKE_PRIO) != 0;
+  r->levels = 0;
+}
+
+// Highest priority among the tasks waiting for the resource
+int __waiting_prio(inheritance_t *r) {
+  if (r->wake_prio)
+    return queue_head_size(r->waiting) > 0
+               ? ((task_t *)r->waiting->first)->wait_prio
+               : PRIO_NONE;
+
+  int prio = PRIO_NONE;
+  task_t *task = (task_t *)r->waiting->first;
+
+  for (int i = 0; i < queue_head_size(r->waiting); i++, task = task->next) {
+    if (__effective_prio(task) < prio)
+      prio = __effective_prio(task);
+  }
+
+  return prio;
+}
+
+// Recomputes what the task inherits from the contended resources it holds,
+// and follows the change down the chain of owners it is waiting for
+void __inherit(task_t *task) {
+  while (task != NULL) {
+    int prio = PRIO_NONE;
+    for (inheritance_t *r = task->held; r != NULL; r = r->next) {
+      if (__waiting_prio(r) < prio)
+        prio = __waiting_prio(r);
+    }
+
+    if (prio == task->prio_i)
+      return;
+
+    task->prio_i = prio;
+    task->prio_d = __effective_prio(task);
+
+    // A ready task moves to the level of its new priority, a waiting one to
+    // its new place in the waiting queue
+    if (task->state == READY && __is_in_another_queue(task)) {
+      __ready_queue_remove(task);
+      __ready_queue_append(task);
+    }
+    __wait_queue_reorder(task);
+
+    task = task->blocked_on != NULL ? task->blocked_on->owner : NULL;
+  }
+}
+
+void __inheritance_link(inheritance_t *r) {
+  r->next = r->owner->held;
+  r->owner->held = r;
+  r->linked = 1;
+}
+
+void __inheritance_unlink(inheritance_t *r) {
+  inheritance_t **link = &r->owner->held;
+  while (*link != r)
+    link = &(*link)->next;
+
+  *link = r->next;
+  r->next = NULL;
+  r->linked = 0;
+}
+
+// Called by the current task once it is queued to wait for the resource
+void __inheritance_block(inheritance_t *r) {
+  current_task->blocked_on = r;
+
+  if (r->owner == NULL)
+    return;
+
+  if (!r->linked)
+    __inheritance_link(r);
+
+  __inherit(r->owner);
+}
+
+// Gives the resource to a new owner (NULL for none), which must no longer
+// be in its waiting queue, and drops what the previous owner inherited
+void __inheritance_transfer(inheritance_t *r, task_t *owner) {
+  task_t *previous = r->owner;
+
+  if (r->linked)
+    __inheritance_unlink(r);
+
+  r->owner = owner;
+
+  if (owner != NULL) {
+    owner->blocked_on = NULL;
+    if (queue_head_size(r->waiting) > 0)
+      __inheritance_link(r);
+    __inherit(owner);
+  }
+
+  if (previous != NULL && previous != owner)
+    __inherit(previous);
 }
@@ -8,10 +8,23 @@
 #define SCHEDULER_AGING_ALPHA 1
 #define DEFAULT_TICK_BUDGET 20
 
+// Set in a mutex's state while tasks wait for it, or once it is destroyed,
+// so that neither fast path (a single compare-and-swap) succeeds
+#define MUTEX_CONTENDED 1
+
+// Timeout of a wait with no deadline, for the functions that take one
+#define WAIT_FOREVER -1
+
+// Compiling with -DTICKLESS replaces the periodic 1 ms tick with a one-shot
+// timer, armed for the earlier of the current quantum end and the earliest
+// sleep deadline, and makes systime() read the monotonic clock.
+
 extern task_t *scheduler();
 extern void dispatcher();
 
-extern task_t *queues[];
+extern queue_head_t queues[];
+extern ready_queue_t ready_queue;
+extern sleep_queue_t sleep_queue;
 extern task_t main_task;
 extern task_t dispatcher_task;
 extern task_t *current_task;
@@ -19,22 +32,65 @@ extern task_t *current_task;
 extern struct sigaction sig;
 extern struct itimerval timer;
 
+extern int live_tasks;
 extern unsigned int system_ticks_count;
+extern unsigned long long boot_us;
+extern unsigned int idle_ticks_count;
+extern short is_idle;
+extern int preemption_disabled;
+extern short preemption_pending;
+extern void (*deferred_work)();
 
-void *__highest_prio_task(void *prev, void *next);
-void __apply_aging(void *ptr);
 void __set_up_signals();
 void __set_up_timer();
 void __set_up_and_queue_main_task();
 void __create_dispatcher_task();
 void __timer_tick_handler();
-void __enter_sem_cs(semaphore_t *s);
-void __leave_sem_cs(semaphore_t *s);
-void __wake_up_first_waiting_task(semaphore_t *s);
+int __can_preempt();
+void __idle();
+void __dispatch(task_t *task);
+void __reschedule();
+int __task_join(task_t *task, int t_ms);
+void __task_entry(void *arg);
+void __queue_by_state(task_t *task);
+void __unblock_signal(int signum);
+int __kernel_signals_blocked();
+void __program_timer(task_t *task);
+unsigned long long __monotonic_us();
+void __enter_cs();
+void __leave_cs();
+void __run_or_defer(void (*work)());
+void __preempt();
+task_t *__wake_up_first_waiting_task(semaphore_t *s);
 void __wake_up_first_task(queue_t *q);
-void __move_to_ready_queue(task_t *queue);
+void __move_to_ready_queue(queue_head_t *queue);
+int __ready_level(task_t *task);
+void __ready_queue_append(task_t *task);
+void __ready_queue_remove(task_t *task);
+int __sleep_queue_reserve(int n);
+void __sleep_queue_insert(task_t *task);
+void __sleep_queue_remove(task_t *task);
 unsigned int __queue_up_tasks_that_should_wake_up();
 unsigned short __is_in_another_queue(task_t *t);
+void __reap_terminated_tasks();
 void __wait_in_semaphore_queue(semaphore_t *s);
+void __wait_queue_insert(inheritance_t *r, task_t *task);
+void __wait_queue_unlink(inheritance_t *r, task_t *task);
+void __wait_queue_reorder(task_t *task);
+task_t *__mutex_owner(mutex_t *m);
+int __sem_down(semaphore_t *s, int t_ms);
+int __sem_down_upto(semaphore_t *s, int n, int t_ms);
+void __wait_deadline(int t_ms);
+void __wait_deadline_cancel(task_t *task);
+void __wait_expire(task_t *task);
+int __wait_timed_out();
+int __time_left(int t_ms, unsigned int deadline);
+int __effective_prio(task_t *task);
+void __inheritance_init(inheritance_t *r, queue_head_t *waiting, int options);
+void __inherit(task_t *task);
+void __inheritance_block(inheritance_t *r);
+void __inheritance_transfer(inheritance_t *r, task_t *owner);
+void *__stack_alloc(size_t *size);
+void __stack_release(void *stack, size_t size);
 
 #endif
@@ -16,32 +16,85 @@ int sem_down(semaphore_t *s) {
 #ifdef DEBUG
   printf("Task %d called sem_down\n", current_task->id);
 #endif
-  if (s == NULL || s->is_destroyed)
+  return __sem_down(s, WAIT_FOREVER);
+}
+
+int sem_down_try(semaphore_t *s) { return __sem_down(s, 0); }
+
+int sem_down_timed(semaphore_t *s, int t_ms) {
+  return __sem_down(s, t_ms > 0 ? t_ms : 0);
+}
+
+// Takes one unit of the semaphore, waiting at most t_ms for it (forever if
+// t_ms is WAIT_FOREVER, not at all if it is 0)
+int __sem_down(semaphore_t *s, int t_ms) {
+  if (s == NULL)
     return -1;
 
-  __enter_sem_cs(s);
-  if (s->is_destroyed)
+  __enter_cs();
+  if (s->is_destroyed || (t_ms == 0 && s->value <= 0)) {
+    __leave_cs();
     return -1;
+  }
 
+  // Queued before leaving the section, so a sem_up can't come in between.
+  // On a timeout, the unit taken from value is given back.
+  int result = 0;
   s->value -= 1;
-
-  __leave_sem_cs(s);
-
   if (s->value < 0) {
+    if (t_ms > 0)
+      __wait_deadline(t_ms);
     __wait_in_semaphore_queue(s);
+    if (__wait_timed_out())
+      result = -1;
+  } else if (s->binary) {
+    __inheritance_transfer(&s->inheritance, current_task);
   }
 
-  return 0;
+  __leave_cs();
+
+  return result;
+}
+
+// Takes one unit of the semaphore, waiting at most t_ms for it, and then up
+// to n - 1 more without waiting. Returns how many it took, or -1.
+int __sem_down_upto(semaphore_t *s, int n, int t_ms) {
+  if (__sem_down(s, t_ms) < 0)
+    return -1;
+  if (n == 1)
+    return 1;
+
+  __enter_cs();
+  int more = s->value < n - 1 ? s->value : n - 1;
+  if (more > 0)
+    s->value -= more;
+  else
+    more = 0;
+  __leave_cs();
+
+  return 1 + more;
 }
 
 int sem_create(semaphore_t *s, int value) {
+  return sem_create_opt(s, value, 0);
+}
+
+int sem_create_binary(semaphore_t *s, int value) {
+  return sem_create_opt(s, value, SEM_BINARY);
+}
+
+int sem_create_opt(semaphore_t *s, int value, int options) {
   if (s == NULL)
     return -1;
 
+  s->binary = (options & SEM_BINARY) != 0;
+  if (s->binary && value > 1)
+    value = 1;
+
   s->value = value;
-  s->waiting = NULL;
+  queue_head_init(&s->waiting);
+  __inheritance_init(&s->inheritance, &s->waiting, options);
   s->is_destroyed = 0;
-  s->lock = 0;
 
   return 0;
 }
@@ -53,9 +106,13 @@ int sem_destroy(semaphore_t *s) {
   if (s == NULL || s->is_destroyed)
     return -1;
 
+  __enter_cs();
   s->is_destroyed = 1;
-
-  __move_to_ready_queue(s->waiting);
+  __move_to_ready_queue(&s->waiting);
+  s->inheritance.levels = 0;
+  if (s->binary)
+    __inheritance_transfer(&s->inheritance, NULL);
+  __leave_cs();
 
   return 0;
 }
@@ -64,60 +121,255 @@ int sem_up(semaphore_t *s) {
 #ifdef DEBUG
   printf("Task %d called sem_up\n", current_task->id);
 #endif
-  if (s == NULL || s->is_destroyed)
+  if (s == NULL)
     return -1;
 
-  __enter_sem_cs(s);
-  if (s->is_destroyed)
+  __enter_cs();
+  if (s->is_destroyed) {
+    __leave_cs();
     return -1;
+  }
 
   s->value += 1;
-  if (s->waiting != NULL)
-    __wake_up_first_waiting_task(s);
+  if (s->binary && s->value > 1)
+    s->value = 1;
+
+  // The task woken up now holds a binary semaphore
+  task_t *next = NULL;
+  if (queue_head_size(&s->waiting) > 0)
+    next = __wake_up_first_waiting_task(s);
+
+  if (s->binary)
+    __inheritance_transfer(&s->inheritance, next);
+
+  __leave_cs();
+
+  return 0;
+}
+
+int sem_up_n(semaphore_t *s, int n) {
+#ifdef DEBUG
+  printf("Task %d called sem_up_n(%d)\n", current_task->id, n);
+#endif
+  if (s == NULL || n < 0)
+    return -1;
+
+  // A binary semaphore wakes one task at most, and hands itself over to it
+  if (s->binary)
+    return n > 0 ? sem_up(s) : 0;
+
+  __enter_cs();
+  if (s->is_destroyed) {
+    __leave_cs();
+    return -1;
+  }
+
+  s->value += n;
+
+  // Waking several tasks moves the whole waiting queue at once
+  int waiting = queue_head_size(&s->waiting);
+  if (waiting > 1 && n >= waiting) {
+    __move_to_ready_queue(&s->waiting);
+    s->inheritance.levels = 0;
+  } else {
+    for (int i = 0; i < n && i < waiting; i++)
+      __wake_up_first_waiting_task(s);
+  }
 
-  __leave_sem_cs(s);
+  __leave_cs();
+
+  return 0;
+}
+
+/*
+ * Mutexes
+ */
+int mutex_create(mutex_t *m) { return mutex_create_opt(m, 0); }
+
+int mutex_create_opt(mutex_t *m, int options) {
+  if (m == NULL)
+    return -1;
+
+  m->state = 0;
+  m->is_destroyed = 0;
+  queue_head_init(&m->waiting);
+  __inheritance_init(&m->inheritance, &m->waiting, options);
+
+  return 0;
+}
+
+task_t *__mutex_owner(mutex_t *m) {
+  return (task_t *)(m->state & ~(uintptr_t)MUTEX_CONTENDED);
+}
+
+int mutex_lock(mutex_t *m) {
+  if (m == NULL)
+    return -1;
+
+  // Free and uncontended
+  if (__sync_bool_compare_and_swap(&m->state, 0, (uintptr_t)current_task))
+    return 0;
+
+  __enter_cs();
+  if (m->is_destroyed || __mutex_owner(m) == current_task) {
+    __leave_cs();
+    return -1;
+  }
+
+  // Released since the compare-and-swap
+  if (m->state == 0) {
+    m->state = (uintptr_t)current_task;
+    __leave_cs();
+    return 0;
+  }
+
+  m->state |= MUTEX_CONTENDED;
+  m->inheritance.owner = __mutex_owner(m);
+  current_task->state = WAITING;
+  __wait_queue_insert(&m->inheritance, current_task);
+  __inheritance_block(&m->inheritance);
+  __reschedule();
+
+  // Either mutex_unlock handed the mutex over, or it was destroyed
+  current_task->blocked_on = NULL;
+  int result = m->is_destroyed ? -1 : 0;
+  __leave_cs();
+
+  return result;
+}
+
+int mutex_unlock(mutex_t *m) {
+  if (m == NULL)
+    return -1;
+
+  // Owned by this task and uncontended
+  if (__sync_bool_compare_and_swap(&m->state, (uintptr_t)current_task, 0))
+    return 0;
+
+  __enter_cs();
+  if (m->is_destroyed || __mutex_owner(m) != current_task) {
+    __leave_cs();
+    return -1;
+  }
+
+  // Hand it straight to the first waiter, so no other task can take it
+  // before the waiter runs
+  task_t *next = (task_t *)m->waiting.first;
+  __wait_queue_unlink(&m->inheritance, next);
+  m->state = (uintptr_t)next;
+  if (queue_head_size(&m->waiting) > 0)
+    m->state |= MUTEX_CONTENDED;
+
+  __inheritance_transfer(&m->inheritance, next);
+  __ready_queue_append(next);
+  __leave_cs();
+
+  return 0;
+}
+
+int mutex_destroy(mutex_t *m) {
+  if (m == NULL)
+    return -1;
+
+  __enter_cs();
+  if (m->is_destroyed) {
+    __leave_cs();
+    return -1;
+  }
+
+  m->is_destroyed = 1;
+  m->state = MUTEX_CONTENDED;
+  __move_to_ready_queue(&m->waiting);
+  m->inheritance.levels = 0;
+  __inheritance_transfer(&m->inheritance, NULL);
+  __leave_cs();
 
   return 0;
 }
 
 /*
  * Barrier
+ *
+ * The last task to arrive releases the others and rearms the barrier for
+ * the next generation. Tasks that arrive while the leader callback runs
+ * already belong to that next generation.
  */
 
 int barrier_create(barrier_t *b, int N) {
+  return barrier_create_leader(b, N, NULL, NULL);
+}
+
+int barrier_create_leader(barrier_t *b, int N, void (*leader)(void *),
+                          void *arg) {
+  check(b == NULL || N < 1);
+
+  queue_head_init(&b->waiting);
   b->current_count = 0;
   b->expected_count = N;
-  b->waiting = NULL;
-  check(sem_create(&b->mutex, 1));
+  b->generation = 0;
+  b->is_destroyed = 0;
+  b->leader = leader;
+  b->leader_arg = arg;
+
   return 0;
 }
 
 int barrier_join(barrier_t *b) {
-
   check(b == NULL);
-  check(sem_down(&(b->mutex)));
+
+  __enter_cs();
+  if (b->is_destroyed) {
+    __leave_cs();
+    return -1;
+  }
 
   b->current_count += 1;
 
-  if (b->current_count == b->expected_count) {
-    __move_to_ready_queue(b->waiting);
-    check(sem_up(&(b->mutex)));
-    return 0;
+  if (b->current_count < b->expected_count) {
+    unsigned int generation = b->generation;
+    current_task->state = WAITING;
+    queue_head_append(&b->waiting, (queue_t *)current_task);
+    __reschedule();
+
+    // Only barrier_destroy wakes the tasks up without a new generation
+    int result = b->generation == generation ? -1 : 0;
+    __leave_cs();
+    return result;
   }
 
-  current_task->state = WAITING;
-  queue_append((queue_t **)&(b->waiting), (queue_t *)current_task);
-  check(sem_up(&(b->mutex)));
+  // Set this generation's tasks aside, so the barrier can be rearmed
+  // before the leader runs
+  queue_head_t released;
+  queue_head_init(&released);
+  if (queue_head_size(&b->waiting) > 0)
+    queue_head_splice(&released, &b->waiting, b->waiting.first->prev,
+                      queue_head_size(&b->waiting));
 
-  task_yield();
-  check(b == NULL);
+  b->current_count = 0;
+  b->generation++;
+  __leave_cs();
+
+  if (b->leader != NULL)
+    b->leader(b->leader_arg);
+
+  __move_to_ready_queue(&released);
 
   return 0;
 }
 
 int barrier_destroy(barrier_t *b) {
   check(b == NULL);
-  b = NULL;
+
+  __enter_cs();
+  if (b->is_destroyed) {
+    __leave_cs();
+    return -1;
+  }
+
+  b->is_destroyed = 1;
+  __move_to_ready_queue(&b->waiting);
+  __leave_cs();
+
   return 0;
 }
 
@@ -125,62 +377,555 @@ int barrier_destroy(barrier_t *b) {
  * Message Queues
  */
 int mqueue_create(mqueue_t *queue, int max, int size) {
+  return mqueue_create_opt(queue, max, size, 0);
+}
+
+int mqueue_create_opt(mqueue_t *queue, int max, int size, int options) {
+  check(queue == NULL || max < 1 || size < 1);
+
+  queue->spsc = (options & MQUEUE_SPSC) != 0;
+  queue->var = (options & MQUEUE_VAR) != 0;
+  check(queue->spsc && queue->var);
+
+  // A variable-length queue must hold at least its largest message
+  check(queue->var && max < (int)sizeof(int) + size);
+
+  if (queue->spsc) {
+    int ring = 1;
+    while (ring < max)
+      ring *= 2;
+    max = ring;
+  }
+
   queue->msg_size = size;
   queue->capacity = max;
-  queue->length = 0;
+  queue->length = queue->writing = queue->reading = 0;
   queue->is_destroyed = 0;
-  queue->tail = queue->head = 0;
+  queue->head = queue->committed = queue->tail = queue->released = 0;
+  queue->prod_waiting = queue->cons_waiting = 0;
+  queue->put = queue->got = 0;
 
-  check(sem_create(&queue->prod_sem, max));
+  // In SPSC mode the semaphores only park a side that has to wait
+  check(sem_create(&queue->prod_sem, queue->spsc ? 0 : max));
   check(sem_create(&queue->cons_sem, 0));
-  check(sem_create(&queue->mutex, 1));
-  check((queue->buffer = malloc(max * size)) == NULL);
+  // A variable-length ring is max bytes; a fixed one, max slots of size
+  size_t bytes = queue->var ? (size_t)max : (size_t)max * size;
+  check((queue->buffer = malloc(bytes)) == NULL);
+
+  if (queue->var) {
+    check(sem_create(&queue->send_sem, 1));
+    check(sem_create(&queue->recv_sem, 1));
+    queue->done = NULL;
+  } else {
+    check((queue->done = calloc(max, 1)) == NULL);
+  }
+
+  return 0;
+}
+
+// Index of a slot handed out by the queue, or -1 if it is not one
+int __mqueue_slot(mqueue_t *queue, void *slot) {
+  long offset = (char *)slot - queue->buffer;
+  if (slot == NULL || offset < 0 || offset % queue->msg_size != 0 ||
+      offset / queue->msg_size >= queue->capacity)
+    return -1;
+  return offset / queue->msg_size;
+}
+
+// Position of the slot counted from start, going around the ring
+int __mqueue_distance(mqueue_t *queue, int start, int slot) {
+  int distance = slot - start;
+  return distance < 0 ? distance + queue->capacity : distance;
+}
+
+// Slot count positions after slot, going around the ring (count is at most
+// the capacity, so no division is needed)
+int __mqueue_advance(mqueue_t *queue, int slot, int count) {
+  slot += count;
+  return slot >= queue->capacity ? slot - queue->capacity : slot;
+}
+
+// Takes up to n units from one of the queue's semaphores, waiting at most
+// t_ms for the first. Fails if the queue is destroyed, even after the task
+// got through the semaphore.
+int __mqueue_down(mqueue_t *queue, semaphore_t *s, int n, int t_ms) {
+  if (queue->is_destroyed)
+    return -1;
+
+  int count = __sem_down_upto(s, n, t_ms);
+  return queue->is_destroyed ? -1 : count;
+}
+
+// Takes count free slots, already taken from prod_sem, and returns the
+// first one
+int __mqueue_reserve(mqueue_t *queue, int count) {
+  __enter_cs();
+  int slot = queue->head;
+  queue->head = __mqueue_advance(queue, queue->head, count);
+  queue->writing += count;
+  __leave_cs();
+
+  return slot;
+}
+
+// Marks count outstanding slots from index as done, and moves the frontier
+// (first outstanding slot) over the done slots at its front. Slots may be
+// done in any order, but the frontier only passes contiguous ones. Returns
+// how many slots it passed.
+int __mqueue_finish(mqueue_t *queue, int *frontier, int *outstanding,
+                    int index, int count) {
+  int passed = 0;
+
+  // The usual case, slots done in order, needs no flags
+  if (index == *frontier) {
+    *frontier = __mqueue_advance(queue, *frontier, count);
+    *outstanding -= count;
+    passed = count;
+  } else {
+    for (int i = 0; i < count; i++)
+      queue->done[__mqueue_advance(queue, index, i)] = 1;
+  }
+
+  while (*outstanding > 0 && queue->done[*frontier]) {
+    queue->done[*frontier] = 0;
+    *frontier = __mqueue_advance(queue, *frontier, 1);
+    *outstanding -= 1;
+    passed++;
+  }
+
+  return passed;
+}
+
+// Marks count reserved slots from index as written. Messages are delivered
+// in the order their slots were reserved.
+void __mqueue_commit(mqueue_t *queue, int index, int count) {
+  __enter_cs();
+  int delivered = __mqueue_finish(queue, &queue->committed, &queue->writing,
+                                  index, count);
+  queue->length += delivered;
+  if (delivered > 0)
+    sem_up_n(&queue->cons_sem, delivered);
+  __leave_cs();
+}
+
+// Takes count ready messages, already taken from cons_sem, and returns the
+// first one
+int __mqueue_borrow(mqueue_t *queue, int count) {
+  __enter_cs();
+  int slot = queue->tail;
+  queue->tail = __mqueue_advance(queue, queue->tail, count);
+  queue->length -= count;
+  queue->reading += count;
+  __leave_cs();
+
+  return slot;
+}
+
+// Marks count borrowed slots from index as read. Slots are reused in ring
+// order.
+void __mqueue_release(mqueue_t *queue, int index, int count) {
+  __enter_cs();
+  int freed = __mqueue_finish(queue, &queue->released, &queue->reading,
+                              index, count);
+  if (freed > 0)
+    sem_up_n(&queue->prod_sem, freed);
+  __leave_cs();
+}
+
+// Copies n bytes between data and a ring of size bytes from pos on, in at
+// most two pieces, since the ring may wrap around. Returns the position
+// after them.
+size_t __ring_copy(char *ring, size_t size, size_t pos, char *data, size_t n,
+                   int to_ring) {
+  size_t first = size - pos < n ? size - pos : n;
+
+  if (to_ring) {
+    memcpy(ring + pos, data, first);
+    memcpy(ring, data + first, n - first);
+  } else {
+    memcpy(data, ring + pos, first);
+    memcpy(data + first, ring, n - first);
+  }
+
+  pos += n;
+  return pos >= size ? pos - size : pos;
+}
+
+// Copies count messages between msgs and the ring from slot on
+void __mqueue_copy(mqueue_t *queue, int slot, char *msgs, int count,
+                   int to_ring) {
+  size_t size = queue->msg_size;
+  __ring_copy(queue->buffer, size * queue->capacity, size * slot, msgs,
+              size * count, to_ring);
+}
+
+// Checks that index is one of the count slots from start still outstanding
+int __mqueue_outstanding(mqueue_t *queue, int start, int count, int index) {
+  return index >= 0 && __mqueue_distance(queue, start, index) < count &&
+         !queue->done[index];
+}
+
+/*
+ * Single producer, single consumer (MQUEUE_SPSC)
+ *
+ * The producer only moves put and the consumer only moves got, free-running
+ * counters over a power-of-two ring, so neither side takes a lock while the
+ * queue is neither full nor empty. A side that finds the queue full (or
+ * empty) flags itself as waiting and blocks inside a critical section: on
+ * one processor the other side can't move its counter between that check
+ * and the flag, and it wakes the waiting side right after moving it.
+ */
+
+// Free slots for the producer, or ready messages for the consumer
+int __spsc_available(mqueue_t *queue, int producer) {
+  unsigned int ready = __atomic_load_n(&queue->put, __ATOMIC_ACQUIRE) -
+                       __atomic_load_n(&queue->got, __ATOMIC_ACQUIRE);
+  return producer ? queue->capacity - ready : ready;
+}
+
+// Waits at most t_ms until the side has at least one slot or message, and
+// returns how many it has, or -1 if the queue is destroyed or time is up
+int __spsc_wait(mqueue_t *queue, int producer, int t_ms) {
+  short *waiting = producer ? &queue->prod_waiting : &queue->cons_waiting;
+  semaphore_t *s = producer ? &queue->prod_sem : &queue->cons_sem;
+  unsigned int deadline = systime() + t_ms;
+
+  for (;;) {
+    if (queue->is_destroyed)
+      return -1;
+
+    int available = __spsc_available(queue, producer);
+    if (available > 0)
+      return available;
+
+    __enter_cs();
+    if (__spsc_available(queue, producer) == 0 && !queue->is_destroyed) {
+      int left = __time_left(t_ms, deadline);
+      if (left == 0) {
+        *waiting = 0;
+        __leave_cs();
+        return -1;
+      }
+
+      // Woken up, timed out or not, it checks the queue again
+      *waiting = 1;
+      __sem_down(s, left);
+    }
+    __leave_cs();
+  }
+}
+
+// Moves the side's counter over count slots, then wakes the other side if
+// it waits for them
+void __spsc_advance(mqueue_t *queue, int producer, int count) {
+  unsigned int *counter = producer ? &queue->put : &queue->got;
+  short *other = producer ? &queue->cons_waiting : &queue->prod_waiting;
+
+  __atomic_store_n(counter, *counter + count, __ATOMIC_RELEASE);
+
+  if (__atomic_load_n(other, __ATOMIC_ACQUIRE)) {
+    __enter_cs();
+    if (*other) {
+      *other = 0;
+      sem_up(producer ? &queue->cons_sem : &queue->prod_sem);
+    }
+    __leave_cs();
+  }
+}
+
+// Ring slot of the side's next message
+int __spsc_slot(mqueue_t *queue, int producer) {
+  return (producer ? queue->put : queue->got) & (queue->capacity - 1);
+}
+
+// Sends (or receives) up to n messages, waiting at most t_ms for the first
+// one only
+int __spsc_transfer(mqueue_t *queue, void *msgs, int n, int producer,
+                    int t_ms) {
+  int count = __spsc_wait(queue, producer, t_ms);
+  check(count < 0);
+
+  if (count > n)
+    count = n;
+  __mqueue_copy(queue, __spsc_slot(queue, producer), msgs, count, producer);
+  __spsc_advance(queue, producer, count);
+
+  return count;
+}
+
+// The slot given to a side, which may only have one outstanding at a time
+void *__spsc_take_slot(mqueue_t *queue, int producer) {
+  if (__spsc_wait(queue, producer, WAIT_FOREVER) < 0)
+    return NULL;
+  return queue->buffer +
+         (size_t)queue->msg_size * __spsc_slot(queue, producer);
+}
+
+int __spsc_give_slot(mqueue_t *queue, void *slot, int producer) {
+  check(__mqueue_slot(queue, slot) != __spsc_slot(queue, producer) ||
+        __spsc_available(queue, producer) == 0);
+
+  __spsc_advance(queue, producer, 1);
+  return 0;
+}
+
+/*
+ * Variable-length messages (MQUEUE_VAR)
+ *
+ * Each message is an int with its size followed by its bytes, back to back
+ * in a byte ring. prod_sem counts free bytes and cons_sem whole messages.
+ * Senders take turns (send_sem) from gathering space to delivering, so two
+ * of them can't each hold part of the ring while waiting for the rest, and
+ * messages land in the order their space was taken. Receivers take turns
+ * (recv_sem) the same way, so space is freed in ring order.
+ */
+
+// Takes need bytes of free space, waiting for them as they are freed until
+// deadline. On failure, the bytes already taken go back to the queue.
+int __mqueue_var_space(mqueue_t *queue, int need, int t_ms,
+                       unsigned int deadline) {
+  for (int have = 0; have < need;) {
+    int count = __mqueue_down(queue, &queue->prod_sem, need - have,
+                              __time_left(t_ms, deadline));
+    if (count < 0) {
+      if (have > 0)
+        sem_up_n(&queue->prod_sem, have);
+      return -1;
+    }
+    have += count;
+  }
+  return 0;
+}
+
+int __mqueue_send_var(mqueue_t *queue, void *msg, int size, int t_ms) {
+  check(queue == NULL || !queue->var || size < 0 || size > queue->msg_size);
+
+  unsigned int deadline = systime() + t_ms;
+  check(__mqueue_down(queue, &queue->send_sem, 1, t_ms) < 0);
+
+  if (__mqueue_var_space(queue, sizeof(int) + size, t_ms, deadline) < 0) {
+    sem_up(&queue->send_sem);
+    return -1;
+  }
+
+  int pos = __ring_copy(queue->buffer, queue->capacity, queue->head,
+                        (char *)&size, sizeof(int), 1);
+  queue->head = __ring_copy(queue->buffer, queue->capacity, pos, msg, size, 1);
+
+  __enter_cs();
+  queue->length++;
+  sem_up(&queue->cons_sem);
+  __leave_cs();
+
+  sem_up(&queue->send_sem);
+  return 0;
+}
+
+int mqueue_send_var(mqueue_t *queue, void *msg, int size) {
+  return __mqueue_send_var(queue, msg, size, WAIT_FOREVER);
+}
+
+int __mqueue_recv_var(mqueue_t *queue, void *msg, int max, int t_ms) {
+  check(queue == NULL || !queue->var || max < 0);
+
+  unsigned int deadline = systime() + t_ms;
+  check(__mqueue_down(queue, &queue->recv_sem, 1, t_ms) < 0);
+
+  if (__mqueue_down(queue, &queue->cons_sem, 1,
+                    __time_left(t_ms, deadline)) < 0) {
+    sem_up(&queue->recv_sem);
+    return -1;
+  }
+
+  int size;
+  int pos = __ring_copy(queue->buffer, queue->capacity, queue->tail,
+                        (char *)&size, sizeof(int), 0);
+
+  // A message that doesn't fit stays at the front of the queue
+  if (size > max) {
+    sem_up(&queue->cons_sem);
+    sem_up(&queue->recv_sem);
+    return -1;
+  }
+
+  queue->tail = __ring_copy(queue->buffer, queue->capacity, pos, msg, size, 0);
+
+  __enter_cs();
+  queue->length--;
+  sem_up_n(&queue->prod_sem, sizeof(int) + size);
+  __leave_cs();
+
+  sem_up(&queue->recv_sem);
+  return size;
+}
+
+int mqueue_recv_var(mqueue_t *queue, void *msg, int max) {
+  return __mqueue_recv_var(queue, msg, max, WAIT_FOREVER);
+}
+
+void *mqueue_send_reserve(mqueue_t *queue) {
+  if (queue != NULL && queue->spsc)
+    return __spsc_take_slot(queue, 1);
+
+  if (queue == NULL || queue->var ||
+      __mqueue_down(queue, &queue->prod_sem, 1, WAIT_FOREVER) < 0)
+    return NULL;
+
+  return queue->buffer + (size_t)queue->msg_size * __mqueue_reserve(queue, 1);
+}
+
+int mqueue_send_commit(mqueue_t *queue, void *slot) {
+  check(queue == NULL || queue->is_destroyed || queue->var);
+  if (queue->spsc)
+    return __spsc_give_slot(queue, slot, 1);
+
+  __enter_cs();
+  int index = __mqueue_slot(queue, slot);
+  if (!__mqueue_outstanding(queue, queue->committed, queue->writing, index)) {
+    __leave_cs();
+    return -1;
+  }
+  __mqueue_commit(queue, index, 1);
+  __leave_cs();
+
+  return 0;
+}
+
+void *mqueue_recv_borrow(mqueue_t *queue) {
+  if (queue != NULL && queue->spsc)
+    return __spsc_take_slot(queue, 0);
+
+  if (queue == NULL || queue->var ||
+      __mqueue_down(queue, &queue->cons_sem, 1, WAIT_FOREVER) < 0)
+    return NULL;
+
+  return queue->buffer + (size_t)queue->msg_size * __mqueue_borrow(queue, 1);
+}
+
+int mqueue_recv_release(mqueue_t *queue, void *slot) {
+  check(queue == NULL || queue->is_destroyed || queue->var);
+  if (queue->spsc)
+    return __spsc_give_slot(queue, slot, 0);
+
+  __enter_cs();
+  int index = __mqueue_slot(queue, slot);
+  if (!__mqueue_outstanding(queue, queue->released, queue->reading, index)) {
+    __leave_cs();
+    return -1;
+  }
+  __mqueue_release(queue, index, 1);
+  __leave_cs();
+
+  return 0;
+}
+
+// Sends a message, waiting at most t_ms for room (forever if t_ms is
+// WAIT_FOREVER, not at all if it is 0)
+int __mqueue_send(mqueue_t *queue, void *msg, int t_ms) {
+  if (queue != NULL && queue->spsc)
+    return __spsc_transfer(queue, msg, 1, 1, t_ms) < 0 ? -1 : 0;
+  if (queue != NULL && queue->var)
+    return __mqueue_send_var(queue, msg, queue->msg_size, t_ms);
+
+  check(queue == NULL ||
+        __mqueue_down(queue, &queue->prod_sem, 1, t_ms) < 0);
+
+  int slot = __mqueue_reserve(queue, 1);
+  memcpy(queue->buffer + (size_t)queue->msg_size * slot, msg, queue->msg_size);
+  __mqueue_commit(queue, slot, 1);
 
   return 0;
 }
 
 int mqueue_send(mqueue_t *queue, void *msg) {
-  check(queue == NULL || queue->is_destroyed);
+  return __mqueue_send(queue, msg, WAIT_FOREVER);
+}
 
-  check(sem_down(&queue->prod_sem));
+int mqueue_send_try(mqueue_t *queue, void *msg) {
+  return __mqueue_send(queue, msg, 0);
+}
 
-  check(sem_down(&queue->mutex));
-  memcpy(queue->buffer + (queue->msg_size * queue->head), msg, queue->msg_size);
-  queue->head = (queue->head + 1) % queue->capacity;
-  queue->length += 1;
-  check(sem_up(&queue->mutex));
+int mqueue_send_timed(mqueue_t *queue, void *msg, int t_ms) {
+  return __mqueue_send(queue, msg, t_ms > 0 ? t_ms : 0);
+}
 
-  check(sem_up(&queue->cons_sem));
+// Receives a message, waiting at most t_ms for one (forever if t_ms is
+// WAIT_FOREVER, not at all if it is 0)
+int __mqueue_recv(mqueue_t *queue, void *msg, int t_ms) {
+  if (queue != NULL && queue->spsc)
+    return __spsc_transfer(queue, msg, 1, 0, t_ms) < 0 ? -1 : 0;
+  if (queue != NULL && queue->var)
+    return __mqueue_recv_var(queue, msg, queue->msg_size, t_ms) < 0 ? -1 : 0;
+
+  check(queue == NULL ||
+        __mqueue_down(queue, &queue->cons_sem, 1, t_ms) < 0);
+
+  int slot = __mqueue_borrow(queue, 1);
+  memcpy(msg, queue->buffer + (size_t)queue->msg_size * slot, queue->msg_size);
+  __mqueue_release(queue, slot, 1);
 
   return 0;
 }
 
 int mqueue_recv(mqueue_t *queue, void *msg) {
-  check(queue == NULL || queue->is_destroyed);
+  return __mqueue_recv(queue, msg, WAIT_FOREVER);
+}
 
-  check(sem_down(&queue->cons_sem));
+int mqueue_recv_try(mqueue_t *queue, void *msg) {
+  return __mqueue_recv(queue, msg, 0);
+}
+
+int mqueue_recv_timed(mqueue_t *queue, void *msg, int t_ms) {
+  return __mqueue_recv(queue, msg, t_ms > 0 ? t_ms : 0);
+}
 
-  check(sem_down(&queue->mutex));
-  memcpy(msg, queue->buffer + (queue->msg_size * queue->tail), queue->msg_size);
-  queue->tail = (queue->tail + 1) % queue->capacity;
-  queue->length -= 1;
-  check(sem_up(&queue->mutex));
+// Waits for the first free slot only, then takes as many as are free
+int mqueue_send_many(mqueue_t *queue, void *msgs, int n) {
+  check(queue == NULL || queue->var || n < 1);
+  if (queue->spsc)
+    return __spsc_transfer(queue, msgs, n, 1, WAIT_FOREVER);
 
-  check(sem_up(&queue->prod_sem));
+  int count = __mqueue_down(queue, &queue->prod_sem, n, WAIT_FOREVER);
+  check(count < 0);
 
-  return 0;
+  int slot = __mqueue_reserve(queue, count);
+  __mqueue_copy(queue, slot, msgs, count, 1);
+  __mqueue_commit(queue, slot, count);
+
+  return count;
+}
+
+// Waits for the first message only, then takes as many as are ready
+int mqueue_recv_many(mqueue_t *queue, void *msgs, int n) {
+  check(queue == NULL || queue->var || n < 1);
+  if (queue->spsc)
+    return __spsc_transfer(queue, msgs, n, 0, WAIT_FOREVER);
+
+  int count = __mqueue_down(queue, &queue->cons_sem, n, WAIT_FOREVER);
+  check(count < 0);
+
+  int slot = __mqueue_borrow(queue, count);
+  __mqueue_copy(queue, slot, msgs, count, 0);
+  __mqueue_release(queue, slot, count);
+
+  return count;
 }
 
 int mqueue_destroy(mqueue_t *queue) {
   queue->is_destroyed = 1;
-  check(sem_destroy(&queue->mutex));
   check(sem_destroy(&queue->prod_sem));
   check(sem_destroy(&queue->cons_sem));
+  if (queue->var) {
+    check(sem_destroy(&queue->send_sem));
+    check(sem_destroy(&queue->recv_sem));
+  }
 
   return 0;
 }
 
 int mqueue_msgs(mqueue_t *queue) {
   check(queue == NULL || queue->is_destroyed);
+  if (queue->spsc)
+    return __spsc_available(queue, 0);
   return queue->length;
 }
@@ -0,0 +1,87 @@
+// Stack pool for PingPong OS
+//
+// Task stacks are mmap'ed with a PROT_NONE guard page below them, so an
+// overflow faults instead of corrupting whatever lies next to the stack.
+// Released stacks are kept in free lists, one per power-of-two number of
+// pages, and handed out again by __stack_alloc.
+
+#include "ppos_internal.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define STACK_CLASSES 24 // up to 2^23 pages per stack
+#define STACK_POOL_MAX 64 // free stacks kept per class, the rest is unmapped
+
+// A free stack keeps the link to the next one in its own memory
+typedef struct free_stack_t {
+  struct free_stack_t *next;
+} free_stack_t;
+
+free_stack_t *free_stacks[STACK_CLASSES];
+int free_stacks_count[STACK_CLASSES];
+
+size_t __page_size() {
+  static size_t page_size = 0;
+  if (page_size == 0)
+    page_size = sysconf(_SC_PAGESIZE);
+  return page_size;
+}
+
+// Rounds size up to its class size and returns the class, or -1 if too big
+int __stack_class(size_t *size) {
+  size_t pages = 1;
+  int class = 0;
+
+  while (pages * __page_size() < *size) {
+    pages *= 2;
+    class++;
+  }
+
+  if (class >= STACK_CLASSES)
+    return -1;
+
+  *size = pages * __page_size();
+  return class;
+}
+
+void *__stack_alloc(size_t *size) {
+  int class = __stack_class(size);
+  if (class < 0)
+    return NULL;
+
+  free_stack_t *stack = free_stacks[class];
+  if (stack != NULL) {
+    free_stacks[class] = stack->next;
+    free_stacks_count[class]--;
+    return stack;
+  }
+
+  size_t guard = __page_size();
+  char *region = mmap(NULL, guard + *size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED)
+    return NULL;
+
+  // Stacks grow down, so the guard page goes at the lowest address
+  if (mprotect(region, guard, PROT_NONE) < 0) {
+    munmap(region, guard + *size);
+    return NULL;
+  }
+
+  return region + guard;
+}
+
+void __stack_release(void *stack, size_t size) {
+  int class = __stack_class(&size);
+
+  if (free_stacks_count[class] >= STACK_POOL_MAX) {
+    size_t guard = __page_size();
+    munmap((char *)stack - guard, guard + size);
+    return;
+  }
+
+  free_stack_t *free_stack = (free_stack_t *)stack;
+  free_stack->next = free_stacks[class];
+  free_stacks[class] = free_stack;
+  free_stacks_count[class]++;
+}
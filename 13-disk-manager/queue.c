@@ -7,8 +7,10 @@
 #include <stdio.h>
 
 // Internal functions
-queue_t *__get_last_elem(queue_t **queue);
 int __queue_has_elem(queue_t **queue, queue_t *elem);
+void __queue_link(queue_t **queue, queue_t *elem);
+void __queue_unlink(queue_t **queue, queue_t *elem);
+int __can_append(queue_t *elem);
 
 void queue_append(queue_t **queue, queue_t *elem) {
   if (queue == NULL) {
@@ -16,32 +18,10 @@ void queue_append(queue_t **queue, queue_t *elem) {
     return;
   }
 
-  if (elem == NULL) {
-    fprintf(stderr, "ERROR(queue_append): element does not exist\n");
-    return;
-  }
-
-  if (elem->next != NULL || elem->prev != NULL) {
-    fprintf(stderr, "ERROR(queue_append): element belongs to another queue\n");
-    return;
-  }
-
-  // The queue is empty
-  if (*queue == NULL) {
-    *queue = elem;
-    elem->next = elem;
-    elem->prev = elem;
+  if (!__can_append(elem))
     return;
-  }
-
-  queue_t *first = *queue;
-  queue_t *last = __get_last_elem(queue);
 
-  last->next = elem;
-  elem->prev = last;
-
-  first->prev = elem;
-  elem->next = first;
+  __queue_link(queue, elem);
 }
 
 queue_t *queue_remove(queue_t **queue, queue_t *elem) {
@@ -50,7 +30,7 @@ queue_t *queue_remove(queue_t **queue, queue_t *elem) {
     return NULL;
   }
 
-  if (queue_size(*queue) == 0) {
+  if (*queue == NULL) {
     fprintf(stderr, "ERROR(queue_remove): queue is empty\n");
     return NULL;
   }
@@ -66,24 +46,7 @@ queue_t *queue_remove(queue_t **queue, queue_t *elem) {
     return NULL;
   }
 
-  // Queue has only one element
-  if (elem->prev == elem && elem->next == elem) {
-    *queue = NULL;
-    elem->prev = NULL;
-    elem->next = NULL;
-    return elem;
-  }
-
-  elem->prev->next = elem->next;
-  elem->next->prev = elem->prev;
-
-  // Move the queue's head if the removed elem is at the beginning
-  if (*queue == elem) {
-    *queue = elem->next;
-  }
-
-  elem->prev = NULL;
-  elem->next = NULL;
+  __queue_unlink(queue, elem);
 
   return elem;
 }
@@ -109,7 +72,7 @@ void queue_print(char *name, queue_t *queue, void (*print_elem)(void *)) {
   queue_t *current = queue;
 
   printf("%s: [", name);
-  for (int i = 0; i < queue_size(queue); i++) {
+  for (int i = 0; i < size; i++) {
     print_elem(current);
     if (i < size - 1) {
       printf(" ");
@@ -120,36 +83,207 @@ void queue_print(char *name, queue_t *queue, void (*print_elem)(void *)) {
 }
 
 void queue_foreach(queue_t *queue, void (*func)(void *)) {
+  int size = queue_size(queue);
   queue_t *current = queue;
-  for (int i = 0; i < queue_size(queue); i++) {
+  for (int i = 0; i < size; i++) {
     func(current);
     current = current->next;
   }
 }
 
 void *queue_reduce(queue_t *queue, void *acc, void *(*func)(void *, void *)) {
+  int size = queue_size(queue);
   queue_t *current = queue;
-  for (int i = 0; i < queue_size(queue); i++) {
+  for (int i = 0; i < size; i++) {
     acc = func(acc, current);
     current = current->next;
   }
   return acc;
 }
 
-// Returns the last element in the queue
-queue_t *__get_last_elem(queue_t **queue) {
-  if (*queue == NULL) {
+void queue_head_init(queue_head_t *head) {
+  head->first = NULL;
+  head->size = 0;
+}
+
+void queue_head_append(queue_head_t *head, queue_t *elem) {
+  if (head == NULL) {
+    fprintf(stderr, "ERROR(queue_head_append): queue does not exist\n");
+    return;
+  }
+
+  if (!__can_append(elem))
+    return;
+
+  __queue_link(&head->first, elem);
+  elem->owner = head;
+  head->size++;
+}
+
+queue_t *queue_head_remove(queue_head_t *head, queue_t *elem) {
+  if (head == NULL) {
+    fprintf(stderr, "ERROR(queue_head_remove): queue does not exist\n");
     return NULL;
   }
 
-  queue_t *firstElem = *queue;
-  queue_t *lastElem = *queue;
+  if (head->size == 0) {
+    fprintf(stderr, "ERROR(queue_head_remove): queue is empty\n");
+    return NULL;
+  }
 
-  do {
-    lastElem = lastElem->next;
-  } while (lastElem->next != firstElem);
+  if (elem == NULL) {
+    fprintf(stderr, "ERROR(queue_head_remove): element does not exist\n");
+    return NULL;
+  }
+
+  if (elem->owner != head) {
+    fprintf(stderr,
+            "ERROR(queue_head_remove): element does not belong to the queue\n");
+    return NULL;
+  }
+
+  __queue_unlink(&head->first, elem);
+  elem->owner = NULL;
+  head->size--;
+
+  return elem;
+}
+
+int queue_head_size(queue_head_t *head) {
+  if (head == NULL)
+    return 0;
+  return head->size;
+}
+
+void queue_head_insert_after(queue_head_t *head, queue_t *pos, queue_t *elem) {
+  if (head == NULL) {
+    fprintf(stderr, "ERROR(queue_head_insert_after): queue does not exist\n");
+    return;
+  }
+
+  if (!__can_append(elem))
+    return;
+
+  if (pos == NULL) {
+    // Linked at the end of a circular queue, it becomes the first one
+    __queue_link(&head->first, elem);
+    head->first = elem;
+  } else {
+    elem->prev = pos;
+    elem->next = pos->next;
+    pos->next->prev = elem;
+    pos->next = elem;
+  }
+
+  elem->owner = head;
+  head->size++;
+}
+
+void queue_head_splice(queue_head_t *dst, queue_head_t *src, queue_t *last,
+                       int count) {
+  queue_t *first = src->first;
+
+  // Close src over the gap
+  if (count == src->size) {
+    src->first = NULL;
+  } else {
+    queue_t *rest = last->next;
+    rest->prev = first->prev;
+    first->prev->next = rest;
+    src->first = rest;
+  }
+  src->size -= count;
+
+  // Put first..last at the end of dst
+  if (dst->first == NULL) {
+    first->prev = last;
+    last->next = first;
+    dst->first = first;
+  } else {
+    queue_t *dst_last = dst->first->prev;
+    dst_last->next = first;
+    first->prev = dst_last;
+    last->next = dst->first;
+    dst->first->prev = last;
+  }
+  dst->size += count;
+
+  for (queue_t *elem = first; count > 0; elem = elem->next, count--)
+    elem->owner = dst;
+}
+
+queue_t *queue_head_unlink(queue_head_t *head, queue_t *elem) {
+#ifdef QUEUE_DEBUG
+  if (elem->owner != head) {
+    fprintf(stderr,
+            "ERROR(queue_head_unlink): element does not belong to the queue\n");
+    return NULL;
+  }
+#endif
+
+  __queue_unlink(&head->first, elem);
+  elem->owner = NULL;
+  head->size--;
+
+  return elem;
+}
+
+// Returns 1 if elem can be appended to a queue, printing the error otherwise
+int __can_append(queue_t *elem) {
+  if (elem == NULL) {
+    fprintf(stderr, "ERROR(queue_append): element does not exist\n");
+    return 0;
+  }
+
+  if (elem->next != NULL || elem->prev != NULL) {
+    fprintf(stderr, "ERROR(queue_append): element belongs to another queue\n");
+    return 0;
+  }
+
+  return 1;
+}
 
-  return lastElem;
+// Links elem at the end of the queue, without any checks
+void __queue_link(queue_t **queue, queue_t *elem) {
+  // The queue is empty
+  if (*queue == NULL) {
+    *queue = elem;
+    elem->next = elem;
+    elem->prev = elem;
+    return;
+  }
+
+  // The queue is circular, so the last element is the first one's prev
+  queue_t *first = *queue;
+  queue_t *last = first->prev;
+
+  last->next = elem;
+  elem->prev = last;
+
+  first->prev = elem;
+  elem->next = first;
+}
+
+// Unlinks elem from the queue, without any checks
+void __queue_unlink(queue_t **queue, queue_t *elem) {
+  // Queue has only one element
+  if (elem->prev == elem && elem->next == elem) {
+    *queue = NULL;
+    elem->prev = NULL;
+    elem->next = NULL;
+    return;
+  }
+
+  elem->prev->next = elem->next;
+  elem->next->prev = elem->prev;
+
+  // Move the queue's head if the removed elem is at the beginning
+  if (*queue == elem) {
+    *queue = elem->next;
+  }
+
+  elem->prev = NULL;
+  elem->next = NULL;
 }
 
 // Returns 1 if the queue has the element in it, 0 otherwise
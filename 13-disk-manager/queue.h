@@ -14,12 +14,27 @@
 //------------------------------------------------------------------------------
 // estrutura de uma fila genérica, sem conteúdo definido.
 // Veja um exemplo de uso desta estrutura em testafila.c
+//
+// O campo owner é preenchido apenas pelas operações queue_head_*, indicando
+// a cabeça de fila à qual o elemento pertence (NULL se fora de uma fila
+// com cabeça). Estruturas usadas como elementos devem repetir os três campos.
 
 typedef struct queue_t {
-  struct queue_t *prev; // aponta para o elemento anterior na fila
-  struct queue_t *next; // aponta para o elemento seguinte na fila
+  struct queue_t *prev;       // aponta para o elemento anterior na fila
+  struct queue_t *next;       // aponta para o elemento seguinte na fila
+  struct queue_head_t *owner; // cabeça da fila que contém o elemento
 } queue_t;
 
+//------------------------------------------------------------------------------
+// cabeça de fila: guarda o primeiro elemento e o número de elementos,
+// permitindo inserção, remoção e contagem em tempo constante.
+// O último elemento é sempre first->prev, pois a fila é circular.
+
+typedef struct queue_head_t {
+  queue_t *first; // aponta para o primeiro elemento da fila
+  int size;       // número de elementos na fila
+} queue_head_t;
+
 //------------------------------------------------------------------------------
 // Insere um elemento no final da fila.
 // Condicoes a verificar, gerando msgs de erro:
@@ -72,4 +87,40 @@ void queue_foreach(queue_t *queue, void (*func)(void *));
 // void reducer(void* acc, void* elem)
 
 void *queue_reduce(queue_t *queue, void *acc, void *(*reduc)(void *, void *));
+
+//------------------------------------------------------------------------------
+// Operações sobre uma cabeça de fila (queue_head_t), com as mesmas condições
+// de erro das operações acima. As funções com queue_t ** continuam
+// disponíveis para filas sem cabeça.
+
+// Inicializa uma cabeça de fila vazia
+void queue_head_init(queue_head_t *head);
+
+// Insere um elemento no final da fila, em O(1)
+void queue_head_append(queue_head_t *head, queue_t *elem);
+
+// Remove o elemento indicado da fila, sem o destruir
+// Retorno: apontador para o elemento removido, ou NULL se erro
+queue_t *queue_head_remove(queue_head_t *head, queue_t *elem);
+
+// Retorno: numero de elementos na fila, em O(1)
+int queue_head_size(queue_head_t *head);
+
+// Insere um elemento logo após pos, que deve pertencer à fila, em O(1).
+// Com pos NULL, o elemento é inserido no início da fila.
+void queue_head_insert_after(queue_head_t *head, queue_t *pos, queue_t *elem);
+
+// Move os count primeiros elementos de src, do primeiro até last, para o
+// final de dst sem religar um a um; só o campo owner é percorrido.
+void queue_head_splice(queue_head_t *dst, queue_head_t *src, queue_t *last,
+                       int count);
+
+//------------------------------------------------------------------------------
+// Remove o elemento indicado da fila sem nenhuma verificação, em O(1).
+// Para uso interno do núcleo, quando se sabe que o elemento pertence à fila.
+// Compilando com -DQUEUE_DEBUG, a pertinência do elemento é verificada
+// (pelo campo owner, também em O(1)).
+// Retorno: apontador para o elemento removido, ou NULL se erro
+
+queue_t *queue_head_unlink(queue_head_t *head, queue_t *elem);
 #endif
@@ -0,0 +1,75 @@
+// PingPongOS - PingPong Operating System
+
+// Teste da barreira cíclica: as mesmas tarefas passam várias vezes pela
+// mesma barreira, e a última a chegar em cada fase soma as contribuições de
+// todas (leader) antes de liberá-las. Depois, destrói uma barreira com uma
+// tarefa esperando.
+
+#include "../ppos.h"
+#include "tests.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUMTASKS 4
+#define PHASES 5
+
+task_t tasks[NUMTASKS], victim;
+barrier_t b, b_destroy;
+int contrib[NUMTASKS], sum[PHASES], phase = 0, errors = 0, victim_result;
+
+// redução da fase, executada pela última tarefa a chegar
+void Reduce(void *arg) {
+  for (int i = 0; i < NUMTASKS; i++)
+    sum[phase] += contrib[i];
+  phase++;
+}
+
+void Body(void *arg) {
+  long id = (long)arg;
+
+  for (int p = 0; p < PHASES; p++) {
+    contrib[id] = (id + 1) * (p + 1);
+    barrier_join(&b);
+
+    // a soma da fase já está pronta para todas
+    if (sum[p] != (p + 1) * NUMTASKS * (NUMTASKS + 1) / 2)
+      errors++;
+  }
+
+  Done();
+}
+
+void VictimBody(void *arg) {
+  victim_result = barrier_join(&b_destroy);
+  Done();
+}
+
+int main(int argc, char *argv[]) {
+  printf("main: inicio\n");
+
+  ppos_init();
+
+  TestInit();
+  barrier_create_leader(&b, NUMTASKS, Reduce, NULL);
+
+  for (long i = 0; i < NUMTASKS; i++)
+    task_create(&tasks[i], Body, (void *)i);
+  WaitDone(NUMTASKS);
+
+  printf("main: %d geracoes, somas:", b.generation);
+  for (int p = 0; p < PHASES; p++)
+    printf(" %d", sum[p]);
+  printf("\n");
+  printf("main: %d tarefas viram uma soma errada\n", errors);
+
+  barrier_create(&b_destroy, 2);
+  task_create(&victim, VictimBody, NULL);
+  task_sleep(20);
+  barrier_destroy(&b_destroy);
+  WaitDone(1);
+  printf("main: barrier_join em barreira destruida: %d\n", victim_result);
+  printf("main: barrier_join apos destruir: %d\n", barrier_join(&b_destroy));
+  printf("main: fim\n");
+
+  exit(0);
+}
@@ -0,0 +1,73 @@
+// PingPongOS - PingPong Operating System
+
+// Teste do estado de ponto flutuante: duas tarefas usam modos de
+// arredondamento diferentes e uma terceira não usa ponto flutuante
+// (task_setfpu). Cada tarefa com fpu deve manter o seu modo entre as trocas.
+
+#include "../ppos.h"
+#include "tests.h"
+#include <fenv.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ROUNDS 1000
+
+task_t up, down, integer;
+int errors[2];
+long sum = 0;
+
+// corpo das tarefas com ponto flutuante
+void FpuBody(void *arg) {
+  long mode = (long)arg;
+  int index = mode == FE_UPWARD ? 0 : 1;
+
+  fesetround(mode);
+
+  for (int i = 0; i < ROUNDS; i++) {
+    task_yield();
+    if (fegetround() != mode)
+      errors[index]++;
+  }
+
+  Done();
+}
+
+// corpo da tarefa sem ponto flutuante
+void IntegerBody(void *arg) {
+  for (int i = 0; i < ROUNDS; i++) {
+    sum += i;
+    task_yield();
+  }
+
+  Done();
+}
+
+int main(int argc, char *argv[]) {
+  printf("main: inicio\n");
+
+  ppos_init();
+
+  TestInit();
+
+  task_create(&up, FpuBody, (void *)FE_UPWARD);
+  task_create(&down, FpuBody, (void *)FE_DOWNWARD);
+  task_create(&integer, IntegerBody, NULL);
+  task_setfpu(&integer, 0);
+
+  WaitDone(1);
+
+  // a tarefa já executou: não pode mais mudar de modo
+  printf("main: task_setfpu em tarefa suspensa: %d\n",
+         task_setfpu(&integer, 1));
+
+  WaitDone(2);
+  printf("main: tarefa sem fpu somou %ld\n", sum);
+
+  printf("main: %d erros de arredondamento (FE_UPWARD)\n", errors[0]);
+  printf("main: %d erros de arredondamento (FE_DOWNWARD)\n", errors[1]);
+  printf("main: modo da main preservado: %s\n",
+         fegetround() == FE_TONEAREST ? "sim" : "nao");
+  printf("main: fim\n");
+
+  exit(0);
+}
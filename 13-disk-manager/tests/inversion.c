@@ -0,0 +1,145 @@
+// PingPongOS - PingPong Operating System
+
+// Teste da herança de prioridade: uma tarefa de baixa prioridade (L) detém
+// um recurso que uma tarefa de alta prioridade (H) pede, enquanto tarefas
+// de prioridade média (M) ocupam o processador. Com herança, H espera no
+// máximo o trabalho restante de L; sem ela, L fica sem processador.
+
+#include "../ppos.h"
+#include "tests.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ROUNDS 3
+#define TOTAL_ROUNDS (2 * ROUNDS + 1)
+#define NUM_HOGS 3
+#define WORK_MS 60 // trabalho de L com o recurso
+#define SLACK_MS 80 // margem: alguns quanta
+
+enum { MUTEX, BINARY, PLAIN };
+
+task_t low[TOTAL_ROUNDS], high[TOTAL_ROUNDS], hog[TOTAL_ROUNDS][NUM_HOGS];
+mutex_t m;
+semaphore_t s;
+int kind, stop, num_rounds = 0;
+long work_steps;
+int wait_ms;
+
+void Lock() {
+  if (kind == MUTEX)
+    mutex_lock(&m);
+  else
+    sem_down(&s);
+}
+
+void Unlock() {
+  if (kind == MUTEX)
+    mutex_unlock(&m);
+  else
+    sem_up(&s);
+}
+
+// trabalho de processamento, em passos
+void Work(long steps) {
+  volatile long sum = 0;
+  for (long i = 0; i < steps; i++)
+    sum += i;
+}
+
+void LowBody(void *arg) {
+  Lock();
+  Work(work_steps);
+  Unlock();
+  Done();
+}
+
+void HighBody(void *arg) {
+  int start = systime();
+  Lock();
+  wait_ms = systime() - start;
+  Unlock();
+  Done();
+}
+
+void HogBody(void *arg) {
+  while (!stop)
+    ;
+  Done();
+}
+
+// executa uma rodada e devolve quanto H esperou pelo recurso; as tarefas
+// de rodadas anteriores continuam bloqueadas, então cada uma usa as suas
+int Round() {
+  stop = 0;
+
+  // L obtém o recurso antes das demais existirem
+  task_create(&low[num_rounds], LowBody, NULL);
+  task_setprio(&low[num_rounds], 19);
+  task_sleep(5);
+
+  task_create(&high[num_rounds], HighBody, NULL);
+  task_setprio(&high[num_rounds], -20);
+  for (int i = 0; i < NUM_HOGS; i++)
+    task_create(&hog[num_rounds][i], HogBody, NULL);
+
+  // L e H terminam; então as M podem parar
+  WaitDone(2);
+  stop = 1;
+  WaitDone(NUM_HOGS);
+
+  num_rounds++;
+  return wait_ms;
+}
+
+// pior espera de H em "rounds" rodadas
+int WorstWait(int rounds) {
+  int worst = 0;
+  for (int i = 0; i < rounds; i++) {
+    int wait = Round();
+    if (wait > worst)
+      worst = wait;
+  }
+  return worst;
+}
+
+int main(int argc, char *argv[]) {
+  printf("main: inicio\n");
+
+  ppos_init();
+
+  TestInit();
+
+  // calibra o trabalho de L para durar ao menos WORK_MS sozinho
+  int work_ms;
+  for (work_steps = 1000;; work_steps *= 2) {
+    int start = systime();
+    Work(work_steps);
+    work_ms = systime() - start;
+    if (work_ms >= WORK_MS)
+      break;
+  }
+  int limit = work_ms + SLACK_MS;
+
+  kind = MUTEX;
+  mutex_create(&m);
+  printf("main: mutex, pior espera de H dentro do limite: %s\n",
+         WorstWait(ROUNDS) <= limit ? "sim" : "nao");
+  mutex_destroy(&m);
+
+  kind = BINARY;
+  sem_create_binary(&s, 1);
+  printf("main: semaforo binario, pior espera de H dentro do limite: %s\n",
+         WorstWait(ROUNDS) <= limit ? "sim" : "nao");
+  sem_destroy(&s);
+
+  // sem herança, L só volta a executar pelo envelhecimento
+  kind = PLAIN;
+  sem_create(&s, 1);
+  printf("main: semaforo comum, pior espera de H dentro do limite: %s\n",
+         WorstWait(1) <= limit ? "sim" : "nao");
+  sem_destroy(&s);
+
+  printf("main: fim\n");
+
+  exit(0);
+}
@@ -0,0 +1,69 @@
+// PingPongOS - PingPong Operating System
+
+// Teste do envio e recebimento em lotes (mqueue_send_many e
+// mqueue_recv_many): lotes limitados pelo espaço livre e pelas mensagens
+// prontas, lotes que dão a volta no anel e uma tarefa que espera por um
+// lote com a fila vazia.
+
+#include "../ppos.h"
+#include "tests.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CAPACITY 4
+
+task_t receiver;
+mqueue_t queue;
+int received[8], num_received;
+
+// espera por um lote com a fila vazia
+void ReceiverBody(void *arg) {
+  num_received = mqueue_recv_many(&queue, received, 8);
+  Done();
+}
+
+void PrintBatch(char *name, int *msgs, int count) {
+  printf("main: %s %d:", name, count);
+  for (int i = 0; i < count; i++)
+    printf(" %d", msgs[i]);
+  printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+  int msgs[8] = {1, 2, 3, 4, 5, 6, 7, 8}, got[8], count;
+
+  printf("main: inicio\n");
+
+  ppos_init();
+
+  TestInit();
+  mqueue_create(&queue, CAPACITY, sizeof(int));
+
+  // só cabem CAPACITY mensagens
+  count = mqueue_send_many(&queue, msgs, 6);
+  printf("main: enviadas %d de 6, %d na fila\n", count, mqueue_msgs(&queue));
+  count = mqueue_recv_many(&queue, got, 8);
+  PrintBatch("recebidas", got, count);
+
+  // o anel dá a volta no meio do lote
+  mqueue_send_many(&queue, msgs, 3);
+  mqueue_recv_many(&queue, got, 3);
+  count = mqueue_send_many(&queue, msgs + 4, 4);
+  printf("main: enviadas %d dando a volta no anel\n", count);
+  count = mqueue_recv_many(&queue, got, 8);
+  PrintBatch("recebidas", got, count);
+
+  // lote esperado com a fila vazia
+  task_create(&receiver, ReceiverBody, NULL);
+  task_sleep(20);
+  mqueue_send_many(&queue, msgs, 3);
+  WaitDone(1);
+  PrintBatch("tarefa recebeu", received, num_received);
+
+  printf("main: lote vazio: %d\n", mqueue_send_many(&queue, msgs, 0));
+  mqueue_destroy(&queue);
+  printf("main: lote apos destruir: %d\n", mqueue_recv_many(&queue, got, 1));
+  printf("main: fim\n");
+
+  exit(0);
+}
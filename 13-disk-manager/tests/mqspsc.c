@@ -0,0 +1,91 @@
+// PingPongOS - PingPong Operating System
+
+// Teste das filas MQUEUE_SPSC: capacidade arredondada para potência de 2,
+// ordem das mensagens sob preempção com a fila cheia e vazia várias vezes,
+// reserva e empréstimo de posições, e destruição com o consumidor esperando.
+
+#include "../ppos.h"
+#include "tests.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CAPACITY 5
+#define MESSAGES 200000
+
+task_t producer, consumer, victim;
+mqueue_t queue;
+long out_of_order, sum;
+
+void ProducerBody(void *arg) {
+  for (long i = 0; i < MESSAGES; i++)
+    mqueue_send(&queue, &i);
+  Done();
+}
+
+// confere que as mensagens chegam em ordem
+void ConsumerBody(void *arg) {
+  long msg;
+  for (long i = 0; i < MESSAGES; i++) {
+    mqueue_recv(&queue, &msg);
+    if (msg != i)
+      out_of_order++;
+    sum += msg;
+  }
+  Done();
+}
+
+// espera numa fila vazia que será destruída
+void VictimBody(void *arg) {
+  long msg;
+  printf("victim: mqueue_recv em fila destruida: %d\n",
+         mqueue_recv(&queue, &msg));
+  Done();
+}
+
+int main(int argc, char *argv[]) {
+  long msg, batch[100] = {0};
+
+  printf("main: inicio\n");
+
+  ppos_init();
+
+  TestInit();
+
+  // a capacidade vira a próxima potência de 2
+  mqueue_create_opt(&queue, CAPACITY, sizeof(long), MQUEUE_SPSC);
+  printf("main: capacidade pedida %d, cabem %d\n", CAPACITY,
+         mqueue_send_many(&queue, batch, 100));
+  mqueue_destroy(&queue);
+
+  // produtor e consumidor concorrentes, com a fila cheia e vazia
+  mqueue_create_opt(&queue, CAPACITY, sizeof(long), MQUEUE_SPSC);
+  task_create(&producer, ProducerBody, NULL);
+  task_create(&consumer, ConsumerBody, NULL);
+  WaitDone(2);
+  printf("main: %d mensagens, %ld fora de ordem, soma %s\n", MESSAGES,
+         out_of_order,
+         sum == (long)MESSAGES * (MESSAGES - 1) / 2 ? "correta" : "errada");
+
+  // reserva e empréstimo: uma posição por vez de cada lado
+  long *slot = mqueue_send_reserve(&queue);
+  *slot = 42;
+  printf("main: commit de posicao alheia: %d\n",
+         mqueue_send_commit(&queue, slot + 1));
+  printf("main: commit: %d\n", mqueue_send_commit(&queue, slot));
+  printf("main: commit repetido: %d\n", mqueue_send_commit(&queue, slot));
+  slot = mqueue_recv_borrow(&queue);
+  printf("main: emprestada %ld, %d na fila\n", *slot, mqueue_msgs(&queue));
+  printf("main: release: %d\n", mqueue_recv_release(&queue, slot));
+  printf("main: release repetido: %d\n", mqueue_recv_release(&queue, slot));
+
+  // destruição com o consumidor esperando
+  task_create(&victim, VictimBody, NULL);
+  task_sleep(20);
+  mqueue_destroy(&queue);
+  WaitDone(1);
+
+  printf("main: mqueue_send apos destruir: %d\n", mqueue_send(&queue, &msg));
+  printf("main: fim\n");
+
+  exit(0);
+}
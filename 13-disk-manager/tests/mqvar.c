@@ -0,0 +1,136 @@
+// PingPongOS - PingPong Operating System
+
+// Teste das filas MQUEUE_VAR: mensagens de tamanhos diferentes que dão a
+// volta no anel, mensagem maior que o espaço de quem recebe, remetente que
+// espera por bytes livres, vários remetentes sob preempção e destruição com
+// uma tarefa esperando.
+
+#include "../ppos.h"
+#include "tests.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BYTES 64
+#define MAX_SIZE 24
+#define NUMSENDERS 3
+#define MESSAGES 20000
+
+task_t sender[NUMSENDERS], blocked, victim;
+mqueue_t queue;
+
+// tamanho da i-ésima mensagem de um remetente
+int Size(int i) { return 1 + i % (MAX_SIZE - 1); }
+
+// envia uma mensagem maior que o espaço livre
+void BlockedBody(void *arg) {
+  char msg[MAX_SIZE] = "mensagem grande";
+  printf("blocked: enviando %d bytes\n", MAX_SIZE);
+  mqueue_send_var(&queue, msg, MAX_SIZE);
+  printf("blocked: enviada\n");
+  Done();
+}
+
+// cada mensagem leva o número do remetente, seguido da sequência
+void SenderBody(void *arg) {
+  char msg[MAX_SIZE];
+  for (int i = 0; i < MESSAGES; i++) {
+    msg[0] = (long)arg;
+    memset(msg + 1, i, Size(i) - 1);
+    mqueue_send_var(&queue, msg, Size(i));
+  }
+  Done();
+}
+
+// espera numa fila vazia que será destruída
+void VictimBody(void *arg) {
+  char msg[MAX_SIZE];
+  printf("victim: mqueue_recv_var em fila destruida: %d\n",
+         mqueue_recv_var(&queue, msg, MAX_SIZE));
+  Done();
+}
+
+int main(int argc, char *argv[]) {
+  char msg[MAX_SIZE + 1];
+  int size;
+
+  printf("main: inicio\n");
+
+  ppos_init();
+
+  TestInit();
+
+  printf("main: anel menor que uma mensagem: %d\n",
+         mqueue_create_opt(&queue, MAX_SIZE, MAX_SIZE, MQUEUE_VAR));
+  printf("main: MQUEUE_VAR com MQUEUE_SPSC: %d\n",
+         mqueue_create_opt(&queue, BYTES, MAX_SIZE, MQUEUE_VAR | MQUEUE_SPSC));
+
+  mqueue_create_opt(&queue, BYTES, MAX_SIZE, MQUEUE_VAR);
+  printf("main: mensagem maior que o maximo: %d\n",
+         mqueue_send_var(&queue, msg, MAX_SIZE + 1));
+  printf("main: mqueue_send_many: %d\n", mqueue_send_many(&queue, msg, 1));
+
+  // várias voltas no anel, com tamanhos que não o dividem
+  int errors = 0;
+  for (int i = 0; i < 100; i++) {
+    char text[MAX_SIZE];
+    snprintf(text, sizeof(text), "msg %d", i);
+    mqueue_send_var(&queue, text, strlen(text) + 1);
+    size = mqueue_recv_var(&queue, msg, MAX_SIZE);
+    if (size != strlen(text) + 1 || strcmp(msg, text) != 0)
+      errors++;
+  }
+  printf("main: 100 mensagens dando a volta no anel, %d erros\n", errors);
+
+  // a mensagem que não cabe fica na fila
+  mqueue_send_var(&queue, "abcdefgh", 9);
+  mqueue_send_var(&queue, "", 0);
+  printf("main: recv em 4 bytes: %d, %d na fila\n",
+         mqueue_recv_var(&queue, msg, 4), mqueue_msgs(&queue));
+  size = mqueue_recv_var(&queue, msg, MAX_SIZE);
+  printf("main: recv em %d bytes: %d \"%s\"\n", MAX_SIZE, size, msg);
+  printf("main: mensagem vazia: %d\n", mqueue_recv_var(&queue, msg, 0));
+
+  // o remetente espera até haver bytes livres para a mensagem inteira
+  for (int i = 0; i < 3; i++)
+    mqueue_send_var(&queue, "0123456789abcdef", 16);
+  task_create(&blocked, BlockedBody, NULL);
+  task_sleep(20);
+  printf("main: %d na fila, recebendo uma\n", mqueue_msgs(&queue));
+  mqueue_recv_var(&queue, msg, MAX_SIZE);
+  task_sleep(20);
+  printf("main: %d na fila, recebendo outra\n", mqueue_msgs(&queue));
+  mqueue_recv_var(&queue, msg, MAX_SIZE);
+  WaitDone(1);
+  while (mqueue_msgs(&queue) > 0)
+    size = mqueue_recv_var(&queue, msg, MAX_SIZE);
+  msg[size] = '\0';
+  printf("main: ultima: %d \"%s\"\n", size, msg);
+
+  // cada remetente entrega suas mensagens em ordem, mesmo intercaladas
+  int next[NUMSENDERS] = {0};
+  errors = 0;
+  for (long i = 0; i < NUMSENDERS; i++)
+    task_create(&sender[i], SenderBody, (void *)i);
+  for (int i = 0; i < NUMSENDERS * MESSAGES; i++) {
+    size = mqueue_recv_var(&queue, msg, MAX_SIZE);
+    int id = msg[0], seq = next[id]++;
+    if (size != Size(seq) || (size > 1 && msg[size - 1] != (char)seq))
+      errors++;
+  }
+  WaitDone(NUMSENDERS);
+  printf("main: %d remetentes, %d mensagens, %d erros\n", NUMSENDERS,
+         NUMSENDERS * MESSAGES, errors);
+
+  // destruição com uma tarefa esperando
+  task_create(&victim, VictimBody, NULL);
+  task_sleep(20);
+  mqueue_destroy(&queue);
+  WaitDone(1);
+
+  printf("main: mqueue_send_var apos destruir: %d\n",
+         mqueue_send_var(&queue, msg, 1));
+  printf("main: fim\n");
+
+  exit(0);
+}
@@ -0,0 +1,72 @@
+// PingPongOS - PingPong Operating System
+
+// Teste da API sem cópia das filas de mensagens: commits fora de ordem
+// entregam as mensagens na ordem das reservas, releases fora de ordem só
+// liberam posições na ordem do anel, e posições inválidas são recusadas.
+
+#include "../ppos.h"
+#include "tests.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+task_t sender;
+mqueue_t queue;
+int sent = 0;
+
+// tenta enviar para a fila cheia
+void SenderBody(void *arg) {
+  int value = 3;
+  mqueue_send(&queue, &value);
+  sent = 1;
+  Done();
+}
+
+int main(int argc, char *argv[]) {
+  int value;
+
+  printf("main: inicio\n");
+
+  ppos_init();
+
+  TestInit();
+  mqueue_create(&queue, 2, sizeof(int));
+
+  // commits fora de ordem
+  int *a = mqueue_send_reserve(&queue);
+  int *b = mqueue_send_reserve(&queue);
+  *a = 1;
+  *b = 2;
+  mqueue_send_commit(&queue, b);
+  printf("main: commit da segunda reserva, %d mensagens\n",
+         mqueue_msgs(&queue));
+  mqueue_send_commit(&queue, a);
+  printf("main: commit da primeira reserva, %d mensagens\n",
+         mqueue_msgs(&queue));
+  printf("main: commit repetido: %d\n", mqueue_send_commit(&queue, a));
+  printf("main: commit de posicao invalida: %d\n",
+         mqueue_send_commit(&queue, (char *)a + 1));
+
+  // releases fora de ordem, com a fila cheia
+  int *x = mqueue_recv_borrow(&queue);
+  int *y = mqueue_recv_borrow(&queue);
+  printf("main: emprestadas as mensagens %d e %d\n", *x, *y);
+  task_create(&sender, SenderBody, NULL);
+
+  mqueue_recv_release(&queue, y);
+  task_sleep(20);
+  printf("main: release da segunda, envio concluido: %d\n", sent);
+  mqueue_recv_release(&queue, x);
+  WaitDone(1);
+  printf("main: release da primeira, envio concluido: %d\n", sent);
+  printf("main: release repetido: %d\n", mqueue_recv_release(&queue, x));
+
+  mqueue_recv(&queue, &value);
+  printf("main: recebida a mensagem %d\n", value);
+
+  mqueue_destroy(&queue);
+  printf("main: reserve apos destruir: %s\n",
+         mqueue_send_reserve(&queue) == NULL ? "NULL" : "endereco");
+  printf("main: fim\n");
+
+  exit(0);
+}
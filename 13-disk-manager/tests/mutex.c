@@ -0,0 +1,97 @@
+// PingPongOS - PingPong Operating System
+
+// Teste de mutexes: entrega do mutex aos que esperam em ordem de chegada,
+// exclusão mútua sob preempção e destruição com tarefas esperando.
+
+#include "../ppos.h"
+#include "tests.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUMWAITERS 3
+#define NUMTASKS 10
+#define NUMSTEPS 1000000
+
+task_t waiter[NUMWAITERS], adder[NUMTASKS], victim;
+mutex_t m, m_sum, m_destroy;
+int order[NUMWAITERS], num_acquired = 0;
+long int soma = 0;
+
+// espera pelo mutex e anota a ordem em que o obteve
+void WaiterBody(void *arg) {
+  mutex_lock(&m);
+  order[num_acquired++] = task_id();
+  mutex_unlock(&m);
+  Done();
+}
+
+// incrementa o contador (seção crítica); a leitura e a escrita são
+// separadas para que uma preempção entre elas perca incrementos
+void AdderBody(void *arg) {
+  for (int i = 0; i < NUMSTEPS; i++) {
+    mutex_lock(&m_sum);
+    long int valor = soma;
+    soma = valor + 1;
+    mutex_unlock(&m_sum);
+  }
+  Done();
+}
+
+// espera por um mutex que será destruído
+void VictimBody(void *arg) {
+  printf("victim: mutex_lock em mutex destruido: %d\n", mutex_lock(&m_destroy));
+  Done();
+}
+
+int main(int argc, char *argv[]) {
+  int i;
+
+  printf("main: inicio\n");
+
+  ppos_init();
+
+  TestInit();
+  mutex_create(&m);
+  mutex_create(&m_sum);
+  mutex_create(&m_destroy);
+
+  // a main segura o mutex enquanto as outras tarefas chegam
+  mutex_lock(&m);
+  for (i = 0; i < NUMWAITERS; i++)
+    task_create(&waiter[i], WaiterBody, NULL);
+  task_sleep(20);
+
+  printf("main: mutex_lock pela dona: %d\n", mutex_lock(&m));
+  mutex_unlock(&m);
+  printf("main: mutex_unlock por quem nao e dona: %d\n", mutex_unlock(&m));
+
+  WaitDone(NUMWAITERS);
+
+  printf("main: ordem de chegada %d %d %d\n", waiter[0].id, waiter[1].id,
+         waiter[2].id);
+  printf("main: ordem de entrada %d %d %d\n", order[0], order[1], order[2]);
+
+  // exclusão mútua com preempção
+  printf("main: %d tarefas somando %d vezes cada\n", NUMTASKS, NUMSTEPS);
+  for (i = 0; i < NUMTASKS; i++)
+    task_create(&adder[i], AdderBody, NULL);
+  WaitDone(NUMTASKS);
+
+  if (soma == NUMTASKS * NUMSTEPS)
+    printf("main: soma deu %ld, valor correto!\n", soma);
+  else
+    printf("main: soma deu %ld, mas deveria ser %d!\n", soma,
+           NUMTASKS * NUMSTEPS);
+
+  // destruição com uma tarefa esperando
+  mutex_lock(&m_destroy);
+  task_create(&victim, VictimBody, NULL);
+  task_sleep(20);
+  mutex_destroy(&m_destroy);
+  WaitDone(1);
+
+  printf("main: mutex_lock apos destruir: %d\n", mutex_lock(&m_destroy));
+  printf("main: fim\n");
+
+  exit(0);
+}
@@ -0,0 +1,69 @@
+// PingPongOS - PingPong Operating System
+
+// Teste de sem_up_n: acorda parte das tarefas bloqueadas, em ordem de
+// chegada, e depois todas de uma vez, deixando o restante no valor do
+// semáforo. Num semáforo binário, acorda no máximo uma tarefa.
+
+#include "../ppos.h"
+#include "tests.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUMTASKS 5
+
+task_t tasks[NUMTASKS], bin_tasks[2];
+semaphore_t s, s_bin;
+int order[NUMTASKS], num_woken = 0, bin_woken = 0;
+
+void Body(void *arg) {
+  sem_down(&s);
+  order[num_woken++] = (long)arg;
+  Done();
+}
+
+void BinBody(void *arg) {
+  sem_down(&s_bin);
+  bin_woken++;
+  Done();
+}
+
+int main(int argc, char *argv[]) {
+  printf("main: inicio\n");
+
+  ppos_init();
+
+  TestInit();
+  sem_create(&s, 0);
+  sem_create_binary(&s_bin, 0);
+
+  for (long i = 0; i < NUMTASKS; i++)
+    task_create(&tasks[i], Body, (void *)i);
+  task_sleep(20);
+
+  sem_up_n(&s, 2);
+  WaitDone(2);
+  printf("main: sem_up_n(2) acordou %d tarefas: %d %d\n", num_woken, order[0],
+         order[1]);
+
+  sem_up_n(&s, 10);
+  WaitDone(NUMTASKS - 2);
+  printf("main: sem_up_n(10) acordou mais %d tarefas: %d %d %d\n",
+         num_woken - 2, order[2], order[3], order[4]);
+  printf("main: valor do semaforo: %d\n", s.value);
+
+  for (int i = 0; i < 2; i++)
+    task_create(&bin_tasks[i], BinBody, NULL);
+  task_sleep(20);
+  sem_up_n(&s_bin, 2);
+  WaitDone(1);
+  task_sleep(20);
+  printf("main: sem_up_n(2) num semaforo binario acordou %d tarefa\n",
+         bin_woken);
+
+  printf("main: sem_up_n com n negativo: %d\n", sem_up_n(&s, -1));
+  sem_destroy(&s);
+  printf("main: sem_up_n apos destruir: %d\n", sem_up_n(&s, 1));
+  printf("main: fim\n");
+
+  exit(0);
+}
@@ -0,0 +1,53 @@
+// PingPongOS - PingPong Operating System
+
+// Teste do heap de tarefas dormindo: 10 mil tarefas dormem ao mesmo tempo,
+// com prazos distintos, e nenhuma deve acordar antes do seu prazo.
+
+#include "../ppos.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_TASKS 10000
+#define MAX_SLEEP 500
+
+task_t tasks[NUM_TASKS];
+semaphore_t s_awake, s_park;
+int early_wakeups = 0;
+
+// corpo das threads
+void Body(void *arg) {
+  long sleep_time = (long)arg;
+  unsigned int deadline = systime() + sleep_time;
+
+  task_sleep(sleep_time);
+
+  if (systime() < deadline)
+    early_wakeups++;
+
+  sem_up(&s_awake);
+
+  // fica bloqueada até o fim do teste
+  sem_down(&s_park);
+}
+
+int main(int argc, char *argv[]) {
+  printf("main: inicio\n");
+
+  ppos_init();
+
+  sem_create(&s_awake, 0);
+  sem_create(&s_park, 0);
+
+  for (long i = 0; i < NUM_TASKS; i++)
+    task_create(&tasks[i], Body, (void *)((i * 7919) % MAX_SLEEP));
+  printf("main: %d tarefas criadas\n", NUM_TASKS);
+
+  for (int i = 0; i < NUM_TASKS; i++)
+    sem_down(&s_awake);
+
+  printf("main: %d tarefas acordaram\n", NUM_TASKS);
+  printf("main: %d tarefas acordaram antes do prazo\n", early_wakeups);
+  printf("main: fim\n");
+
+  exit(0);
+}
@@ -0,0 +1,32 @@
+// PingPongOS - PingPong Operating System
+
+// Apoio comum aos testes. As tarefas de um teste não terminam com task_exit,
+// que imprime tempos diferentes a cada execução: ao fim, cada uma chama
+// Done e fica bloqueada, e a main espera por elas com WaitDone.
+
+#ifndef __PPOS_TESTS__
+#define __PPOS_TESTS__
+
+#include "../ppos.h"
+
+static semaphore_t s_done, s_park;
+
+// prepara o apoio aos testes; chamar depois de ppos_init
+static inline void TestInit() {
+  sem_create(&s_done, 0);
+  sem_create(&s_park, 0);
+}
+
+// avisa a main e fica bloqueada até o fim do teste
+static inline void Done() {
+  sem_up(&s_done);
+  sem_down(&s_park);
+}
+
+// espera até n tarefas chamarem Done
+static inline void WaitDone(int n) {
+  for (int i = 0; i < n; i++)
+    sem_down(&s_done);
+}
+
+#endif
@@ -0,0 +1,185 @@
+// PingPongOS - PingPong Operating System
+
+// Teste das variantes sem espera (_try) e com prazo (_timed) de sem_down,
+// mqueue_send, mqueue_recv e task_join: prazos que expiram, esperas
+// atendidas antes do prazo, o valor do semáforo depois de prazos expirados
+// e muitas tarefas esperando com prazos diferentes.
+
+#include "../ppos.h"
+#include "tests.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUMWAITERS 20
+#define ROUNDS 10
+#define UPS 100
+
+task_t helper[3], waiter[2 + NUMWAITERS], sleeper;
+semaphore_t s;
+mqueue_t queue;
+int order[2], num_woken, successes;
+
+// libera o semáforo depois de um tempo
+void UpLaterBody(void *arg) {
+  task_sleep((long)arg);
+  sem_up(&s);
+  Done();
+}
+
+// envia uma mensagem depois de um tempo
+void SendLaterBody(void *arg) {
+  int msg = 7;
+  task_sleep((long)arg);
+  mqueue_send(&queue, &msg);
+  Done();
+}
+
+// espera pelo semáforo, com ou sem prazo, e anota a ordem
+void OrderBody(void *arg) {
+  long t_ms = (long)arg;
+  int result = t_ms > 0 ? sem_down_timed(&s, t_ms) : sem_down(&s);
+  if (result == 0)
+    order[num_woken++] = t_ms;
+  Done();
+}
+
+// espera repetidamente pelo semáforo com prazos curtos
+void WaiterBody(void *arg) {
+  for (int i = 0; i < ROUNDS; i++) {
+    if (sem_down_timed(&s, 2 + (long)arg % 7) == 0)
+      successes++;
+  }
+  Done();
+}
+
+void SleeperBody(void *arg) {
+  task_sleep(100);
+  task_exit(42);
+}
+
+// quanto tempo a chamada levou, em ms
+#define ELAPSED(call, result)                                                  \
+  do {                                                                         \
+    int start = systime();                                                     \
+    result = call;                                                             \
+    elapsed = systime() - start;                                               \
+  } while (0)
+
+int main(int argc, char *argv[]) {
+  int result, elapsed, msg = 1;
+
+  printf("main: inicio\n");
+
+  ppos_init();
+
+  TestInit();
+
+  // semáforos
+  sem_create(&s, 1);
+  printf("main: sem_down_try disponivel: %d\n", sem_down_try(&s));
+  printf("main: sem_down_try indisponivel: %d\n", sem_down_try(&s));
+  ELAPSED(sem_down_timed(&s, 50), result);
+  printf("main: sem_down_timed 50 ms: %d, esperou o prazo: %s\n", result,
+         elapsed >= 50 ? "sim" : "nao");
+
+  task_create(&helper[0], UpLaterBody, (void *)20);
+  ELAPSED(sem_down_timed(&s, 1000), result);
+  printf("main: sem_down_timed atendido: %d, antes do prazo: %s\n", result,
+         elapsed < 1000 ? "sim" : "nao");
+  WaitDone(1);
+
+  // o prazo atendido não pode expirar depois, durante outra espera
+  task_create(&helper[1], UpLaterBody, (void *)1200);
+  ELAPSED(sem_down(&s), result);
+  printf("main: sem_down depois do prazo antigo: %d, esperou o sem_up: %s\n",
+         result, elapsed >= 1200 ? "sim" : "nao");
+  WaitDone(1);
+
+  // quem desiste devolve seu lugar: o sem_up seguinte vai para a outra
+  num_woken = 0;
+  task_create(&waiter[0], OrderBody, (void *)30);
+  task_create(&waiter[1], OrderBody, (void *)0);
+  task_sleep(60);
+  sem_up(&s);
+  WaitDone(2);
+  printf("main: acordadas %d, a sem prazo: %s\n", num_woken,
+         num_woken == 1 && order[0] == 0 ? "sim" : "nao");
+  printf("main: semaforo vazio depois: %s\n",
+         sem_down_try(&s) < 0 ? "sim" : "nao");
+
+  // muitas tarefas com prazos diferentes; ao final, o valor do semáforo
+  // deve ser o número de sem_up menos o de sem_down atendidos
+  successes = 0;
+  for (long i = 0; i < NUMWAITERS; i++)
+    task_create(&waiter[2 + i], WaiterBody, (void *)i);
+  for (int i = 0; i < UPS; i++) {
+    sem_up(&s);
+    task_sleep(1);
+  }
+  WaitDone(NUMWAITERS);
+  int left = 0;
+  while (sem_down_try(&s) == 0)
+    left++;
+  printf("main: %d sem_up, %s\n", UPS,
+         successes + left == UPS ? "contagem consistente" : "contagem errada");
+  sem_destroy(&s);
+
+  // filas de mensagens
+  mqueue_create(&queue, 2, sizeof(int));
+  printf("main: mqueue_recv_try vazia: %d\n", mqueue_recv_try(&queue, &msg));
+  printf("main: mqueue_send_try:");
+  for (int i = 0; i < 3; i++)
+    printf(" %d", mqueue_send_try(&queue, &msg));
+  printf("\n");
+  ELAPSED(mqueue_send_timed(&queue, &msg, 30), result);
+  printf("main: mqueue_send_timed cheia: %d, esperou o prazo: %s\n", result,
+         elapsed >= 30 ? "sim" : "nao");
+  mqueue_recv_try(&queue, &msg);
+  mqueue_recv_try(&queue, &msg);
+  ELAPSED(mqueue_recv_timed(&queue, &msg, 30), result);
+  printf("main: mqueue_recv_timed vazia: %d, esperou o prazo: %s\n", result,
+         elapsed >= 30 ? "sim" : "nao");
+  task_create(&helper[2], SendLaterBody, (void *)20);
+  msg = 0;
+  ELAPSED(mqueue_recv_timed(&queue, &msg, 1000), result);
+  printf("main: mqueue_recv_timed atendido: %d, mensagem %d, antes do prazo: "
+         "%s\n",
+         result, msg, elapsed < 1000 ? "sim" : "nao");
+  WaitDone(1);
+  printf("main: mensagens na fila: %d\n", mqueue_msgs(&queue));
+  mqueue_destroy(&queue);
+
+  mqueue_create_opt(&queue, 2, sizeof(int), MQUEUE_SPSC);
+  ELAPSED(mqueue_recv_timed(&queue, &msg, 30), result);
+  printf("main: SPSC, mqueue_recv_timed vazia: %d, esperou o prazo: %s\n",
+         result, elapsed >= 30 ? "sim" : "nao");
+  mqueue_send(&queue, &msg);
+  printf("main: SPSC, mqueue_recv_try: %d\n", mqueue_recv_try(&queue, &msg));
+  mqueue_destroy(&queue);
+
+  // a mensagem de 8 bytes (com o tamanho) não cabe nos 6 livres
+  mqueue_create_opt(&queue, 12, sizeof(int), MQUEUE_VAR);
+  char bytes[2] = {1, 2};
+  mqueue_send_var(&queue, bytes, 2);
+  ELAPSED(mqueue_send_timed(&queue, &msg, 30), result);
+  printf("main: VAR, mqueue_send_timed sem espaco: %d, esperou o prazo: %s\n",
+         result, elapsed >= 30 ? "sim" : "nao");
+  mqueue_recv_var(&queue, bytes, 2);
+  printf("main: VAR, mqueue_send_try com a fila vazia: %d\n",
+         mqueue_send_try(&queue, &msg));
+  mqueue_destroy(&queue);
+
+  // task_join
+  task_create(&sleeper, SleeperBody, NULL);
+  printf("main: task_join_try em execucao: %d\n", task_join_try(&sleeper));
+  ELAPSED(task_join_timed(&sleeper, 30), result);
+  printf("main: task_join_timed 30 ms: %d, esperou o prazo: %s\n", result,
+         elapsed >= 30 ? "sim" : "nao");
+  printf("main: task_join_timed 1000 ms: %d\n",
+         task_join_timed(&sleeper, 1000));
+  printf("main: task_join_try terminada: %d\n", task_join_try(&sleeper));
+
+  printf("main: fim\n");
+
+  exit(0);
+}
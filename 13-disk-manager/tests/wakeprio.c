@@ -0,0 +1,93 @@
+// PingPongOS - PingPong Operating System
+
+// Teste da política de despertar por prioridade (WAKE_PRIO): as tarefas
+// chegam à fila de espera todas com a mesma prioridade, que muda enquanto
+// esperam. Sem WAKE_PRIO, acordam em ordem de chegada; com WAKE_PRIO, pela
+// prioridade, e em ordem de chegada entre as de mesma prioridade.
+
+#include "../ppos.h"
+#include "tests.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUMTASKS 5
+#define NUMRUNS 3
+
+int prios[NUMTASKS] = {5, -3, 5, 0, -3};
+
+task_t tasks[NUMRUNS][NUMTASKS];
+semaphore_t s;
+mutex_t m;
+int use_mutex, order[NUMTASKS], num_woken;
+
+// espera pelo recurso, anota a ordem e o passa adiante
+void Body(void *arg) {
+  if (use_mutex) {
+    mutex_lock(&m);
+    order[num_woken++] = (long)arg;
+    mutex_unlock(&m);
+  } else {
+    sem_down(&s);
+    order[num_woken++] = (long)arg;
+    sem_up(&s);
+  }
+  Done();
+}
+
+void Run(int run, char *name) {
+  num_woken = 0;
+
+  // a main segura o recurso enquanto as outras tarefas chegam
+  if (use_mutex)
+    mutex_lock(&m);
+  for (long i = 0; i < NUMTASKS; i++)
+    task_create(&tasks[run][i], Body, (void *)i);
+  task_sleep(20);
+
+  // as prioridades mudam com as tarefas já na fila
+  for (int i = 0; i < NUMTASKS; i++)
+    task_setprio(&tasks[run][i], prios[i]);
+
+  if (use_mutex)
+    mutex_unlock(&m);
+  else
+    sem_up(&s);
+
+  WaitDone(NUMTASKS);
+
+  printf("main: %s, ordem de despertar:", name);
+  for (int i = 0; i < NUMTASKS; i++)
+    printf(" %d", order[i]);
+  printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+  printf("main: inicio\n");
+
+  ppos_init();
+
+  TestInit();
+
+  printf("main: prioridades:");
+  for (int i = 0; i < NUMTASKS; i++)
+    printf(" %d", prios[i]);
+  printf("\n");
+
+  use_mutex = 0;
+  sem_create(&s, 0);
+  Run(0, "semaforo em ordem de chegada");
+  sem_destroy(&s);
+
+  sem_create_opt(&s, 0, WAKE_PRIO);
+  Run(1, "semaforo por prioridade");
+  sem_destroy(&s);
+
+  use_mutex = 1;
+  mutex_create_opt(&m, WAKE_PRIO);
+  Run(2, "mutex por prioridade");
+  mutex_destroy(&m);
+
+  printf("main: fim\n");
+
+  exit(0);
+}